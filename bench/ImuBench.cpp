@@ -0,0 +1,395 @@
+/**
+ * Microbenchmarks for the Vector3D, Quaternion and Dual operations.
+ *
+ * Every operation is timed at float and double over a small working set
+ * that stays in L1, as best of several repetitions.  Reported per operation:
+ * ns/op, Mop/s and, where Linux perf_event is available, cycles and
+ * instructions per op.
+ *
+ * Build and run:
+ *
+ *     g++ -std=c++11 -O2 -march=native -Ilib bench/ImuBench.cpp -o imubench
+ *     ./imubench [--filter substr] [--json out.json] [--baseline old.json] [--threshold pct]
+ *
+ * --json writes one JSON object per line per benchmark.  --baseline reads
+ * such a file back and prints the change against it; the exit status is 1
+ * if any benchmark got slower by more than --threshold percent (default 5).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <QuaternionBatch.h>
+#include <Dual.h>
+#include <VectorExpr.h>
+#include <RotationMatrix.h>
+#include <EulerBatch.h>
+#include <MEKF.h>
+#include <Rotation2D.h>
+#include <Reverse.h>
+
+using namespace IMU;
+
+/** Keep the compiler from discarding or hoisting a value.
+ */
+template <typename V>
+static inline void
+escape(V & v)
+{
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+/** Hardware cycle and instruction counters for this process, if the kernel allows it.
+ */
+class PerfCounters
+{
+    public:
+
+    PerfCounters(void) : cycles(-1), instrs(-1)
+    {
+#if defined(__linux__)
+        cycles = open(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (cycles >= 0) instrs = open(PERF_COUNT_HW_INSTRUCTIONS, cycles);
+#endif
+    }
+
+    ~PerfCounters(void)
+    {
+#if defined(__linux__)
+        if (instrs >= 0) close(instrs);
+        if (cycles >= 0) close(cycles);
+#endif
+    }
+
+    bool available(void) const { return cycles >= 0 && instrs >= 0; };
+
+    void start(void)
+    {
+#if defined(__linux__)
+        if (!available()) return;
+        ioctl(cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    void stop(uint64_t & cyc, uint64_t & ins)
+    {
+        cyc = ins = 0;
+#if defined(__linux__)
+        if (!available()) return;
+        ioctl(cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        if (read(cycles, &cyc, sizeof(cyc)) != sizeof(cyc)) cyc = 0;
+        if (read(instrs, &ins, sizeof(ins)) != sizeof(ins)) ins = 0;
+#endif
+    }
+
+    private:
+
+#if defined(__linux__)
+    static int open(uint64_t config, int group)
+    {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = config;
+        attr.disabled       = (group < 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+
+        return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+    }
+#endif
+
+    int cycles;
+    int instrs;
+};
+
+struct Result
+{
+    std::string name;
+    std::string type;
+    double      ns;
+    double      cycles;
+    double      instrs;
+};
+
+static const size_t SET  = 256;     // working set, power of two
+static const int    REPS = 7;
+
+/**
+ * Time op(i) for i in [0, iters), best of REPS, with iters calibrated to
+ * roughly 10 ms per repetition.
+ */
+template <class Op>
+static Result
+measure(PerfCounters & perf, const char * name, const char * type, Op op)
+{
+    typedef std::chrono::steady_clock clock;
+    Result res = { name, type, 1e30, -1, -1 };
+    size_t iters = SET;
+
+    for (;;)
+    {
+        clock::time_point t0 = clock::now();
+        for (size_t i = 0; i < iters; i++) op(i & (SET - 1));
+        if (std::chrono::duration<double>(clock::now() - t0).count() > 0.01 || iters > ((size_t)1 << 32)) break;
+        iters *= 2;
+    }
+
+    for (int r = 0; r < REPS; r++)
+    {
+        uint64_t cyc, ins;
+
+        perf.start();
+        clock::time_point t0 = clock::now();
+        for (size_t i = 0; i < iters; i++) op(i & (SET - 1));
+        double ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / iters;
+        perf.stop(cyc, ins);
+
+        if (ns < res.ns)
+        {
+            res.ns = ns;
+            if (perf.available())
+            {
+                res.cycles = (double)cyc / iters;
+                res.instrs = (double)ins / iters;
+            }
+        }
+    }
+    return res;
+}
+
+template <typename T>
+struct Data
+{
+    Vector3D<T>   v[SET], w[SET], vo[SET];
+    Quaternion<T> q[SET], p[SET], qo[SET];
+    Dual<T>       d[SET], e[SET], dout[SET];
+    Vector3D<Dual<T> > dv[SET], dw[SET], dvo[SET];
+    T             s[SET], so[SET];
+    RotationMatrix<T> m;
+    T             x[SET], y[SET], z[SET];
+    MEKF<T>       ekf;
+    Rotation2D<T> r2[SET], p2[SET], r2o[SET];
+    Vector2D<T>   v2[SET], v2o[SET];
+    Odometry2D<T> odo;
+    Tape<T>       tape;
+
+    Data(void) : ekf(200, T(0.01), T(0.001), T(0.05), T(0.05))
+    {
+        srand(1);
+        for (size_t i = 0; i < SET; i++)
+        {
+            v[i].set(r(), r(), r());
+            w[i].set(r(), r(), r());
+            q[i].set(r(), r(), r(), r());
+            p[i].set(r(), r(), r(), r());
+            q[i].normalize();
+            p[i].normalize();
+            m = RotationMatrix<T>(q[i]);
+            d[i] = Dual<T>(r() + 2, r());
+            e[i] = Dual<T>(r() + 2, r());
+            dv[i].set(Dual<T>(r(), r()), Dual<T>(r(), r()), Dual<T>(r(), r()));
+            dw[i].set(Dual<T>(r(), r()), Dual<T>(r(), r()), Dual<T>(r(), r()));
+            s[i] = r() + 2;
+            x[i] = r(), y[i] = r(), z[i] = r();
+            r2[i] = Rotation2D<T>(4 * r());
+            p2[i] = Rotation2D<T>(4 * r());
+            v2[i].set(r(), r());
+        }
+    }
+
+    static T r(void) { return (T)rand() / RAND_MAX - T(0.5); };
+};
+
+template <typename T>
+static void
+suite(PerfCounters & perf, const char * type, const char * filter, std::vector<Result> & out)
+{
+    static Data<T> D;
+    Data<T> & d = D;
+
+#define BENCH(name, body)                                                                   \
+    if (!filter || strstr(name, filter))                                                    \
+    {                                                                                       \
+        out.push_back(measure(perf, name, type, [&](size_t i) { body; }));                  \
+    }
+
+    BENCH("Vector3D::dot",            d.so[i] = d.v[i].dot(d.w[i]); escape(d.so[i]))
+    BENCH("Vector3D::cross",          d.vo[i] = d.v[i].cross(d.w[i]); escape(d.vo[i]))
+    BENCH("Vector3D::length",         d.so[i] = d.v[i].length(); escape(d.so[i]))
+    BENCH("Vector3D::norm",           d.vo[i] = d.v[i].norm(); escape(d.vo[i]))
+    BENCH("Vector3D::normalize",      d.vo[i] = d.v[i]; d.vo[i].normalize(); escape(d.vo[i]))
+    BENCH("Vector3D::operator+",      d.vo[i] = d.v[i] + d.w[i]; escape(d.vo[i]))
+    BENCH("Vector3D::operator-",      d.vo[i] = d.v[i] - d.w[i]; escape(d.vo[i]))
+    BENCH("Vector3D::operator*T",     d.vo[i] = d.v[i] * d.s[i]; escape(d.vo[i]))
+    BENCH("Vector3D::operator/T",     d.vo[i] = d.v[i] / d.s[i]; escape(d.vo[i]))
+    BENCH("Vector3D::operator+=",     d.vo[i] += d.w[i]; escape(d.vo[i]))
+    BENCH("Vector3D::a+b*s-c",        d.vo[i] = d.v[i] + d.w[i] * d.s[i] - d.vo[i]; escape(d.vo[i]))
+    BENCH("VectorExpr::a+b*s-c",      d.vo[i] = lazy(d.v[i]) + lazy(d.w[i]) * d.s[i] - d.vo[i]; escape(d.vo[i]))
+    BENCH("Vector3D<Dual>::a+b*s-c",  d.dvo[i] = d.dv[i] + d.dw[i] * d.d[i] - d.dvo[i]; escape(d.dvo[i]))
+    BENCH("VectorExpr<Dual>::a+b*s-c", d.dvo[i] = lazy(d.dv[i]) + lazy(d.dw[i]) * d.d[i] - d.dvo[i]; escape(d.dvo[i]))
+
+    BENCH("Quaternion::operator*",    d.qo[i] = d.q[i] * d.p[i]; escape(d.qo[i]))
+    BENCH("Quaternion::operator*=",   d.qo[i] = d.q[i]; d.qo[i] *= d.p[i]; escape(d.qo[i]))
+    BENCH("Quaternion::operator+",    d.qo[i] = d.q[i] + d.p[i]; escape(d.qo[i]))
+    BENCH("Quaternion::operator-",    d.qo[i] = d.q[i] - d.p[i]; escape(d.qo[i]))
+    BENCH("Quaternion::conj",         d.qo[i] = d.q[i].conj(); escape(d.qo[i]))
+    BENCH("Quaternion::dot",          d.so[i] = d.q[i].dot(d.p[i]); escape(d.so[i]))
+    BENCH("Quaternion::length",       d.so[i] = d.q[i].length(); escape(d.so[i]))
+    BENCH("Quaternion::norm",         d.qo[i] = d.q[i].norm(); escape(d.qo[i]))
+    BENCH("Quaternion::normalize",    d.qo[i] = d.q[i]; d.qo[i].normalize(); escape(d.qo[i]))
+    BENCH("Quaternion::rot",          d.vo[i] = d.q[i].rot(d.v[i]); escape(d.vo[i]))
+    BENCH("Quaternion::getEulerAngles", d.vo[i] = d.q[i].getEulerAngles(); escape(d.vo[i]))
+    BENCH("eulerBatch/exact",         if (i == 0) { eulerBatch(d.q, d.vo, SET, EULER_LEGACY, EULER_EXACT); } escape(d.vo[0]))
+    BENCH("eulerBatch/approx",        if (i == 0) { eulerBatch(d.q, d.vo, SET, EULER_LEGACY, EULER_APPROX); } escape(d.vo[0]))
+    BENCH("Quaternion::gVec",         d.vo[i] = d.q[i].gVec(); escape(d.vo[i]))
+    BENCH("RotationMatrix(q)",        RotationMatrix<T> m(d.q[i]); escape(m))
+    BENCH("RotationMatrix::apply",    d.vo[i] = d.m.apply(d.v[i]); escape(d.vo[i]))
+    BENCH("RotationMatrix::toQuaternion", d.qo[i] = d.m.toQuaternion(); escape(d.qo[i]))
+    BENCH("rotBatch/vector",          if (i == 0) { rotBatch(d.q[0], d.x, d.y, d.z, SET); } escape(d.x[0]))
+    BENCH("Rotation2D::operator*",    d.r2o[i] = d.r2[i] * d.p2[i]; escape(d.r2o[i]))
+    BENCH("Rotation2D::rot",          d.v2o[i] = d.r2[i].rot(d.v2[i]); escape(d.v2o[i]))
+    BENCH("rotBatch/2D",              if (i == 0) { rotBatch(d.r2[0], d.x, d.y, SET); } escape(d.x[0]))
+    BENCH("Odometry2D::update",       d.odo.update(d.x[i] * T(0.01), d.s[i] * T(0.01)); escape(d.odo))
+    BENCH("Var::rot+gradient",        d.tape.reset(); Quaternion<Var<T> > q(Var<T>(d.tape, d.q[i].W()), Var<T>(d.tape, d.q[i].X()), Var<T>(d.tape, d.q[i].Y()), Var<T>(d.tape, d.q[i].Z()));
+                                      Vector3D<Var<T> > r = q.rot(Vector3D<Var<T> >(d.v[i].X(), d.v[i].Y(), d.v[i].Z())); Var<T> l = r.dot(r); d.tape.gradient(l); d.so[i] = l.adjoint(); escape(d.so[i]))
+    BENCH("MEKF::predict",            d.ekf.predict(d.v[i], T(0.005)); escape(d.ekf))
+    BENCH("MEKF::update",             d.ekf.update(d.v[i], d.q[i].gVec(), d.w[i]); escape(d.ekf))
+
+    BENCH("Dual::operator+",          d.dout[i] = d.d[i] + d.e[i]; escape(d.dout[i]))
+    BENCH("Dual::operator*",          d.dout[i] = d.d[i] * d.e[i]; escape(d.dout[i]))
+    BENCH("Dual::operator/",          d.dout[i] = d.d[i] / d.e[i]; escape(d.dout[i]))
+    BENCH("Dual::pow(T)",             d.dout[i] = d.d[i].pow(d.s[i]); escape(d.dout[i]))
+    BENCH("Dual::pow(Dual)",          d.dout[i] = d.d[i].pow(d.e[i]); escape(d.dout[i]))
+    BENCH("Dual::sqrt",               d.dout[i] = d.d[i].sqrt(); escape(d.dout[i]))
+    BENCH("Dual::exp",                d.dout[i] = d.d[i].exp(); escape(d.dout[i]))
+    BENCH("Dual::log",                d.dout[i] = d.d[i].log(); escape(d.dout[i]))
+    BENCH("Dual::sin",                d.dout[i] = d.d[i].sin(); escape(d.dout[i]))
+    BENCH("Dual::cos",                d.dout[i] = d.d[i].cos(); escape(d.dout[i]))
+    BENCH("Dual::inv",                d.dout[i] = d.d[i].inv(); escape(d.dout[i]))
+
+#undef BENCH
+}
+
+/** Read back a file written by --json.
+ */
+static std::map<std::string, double>
+loadBaseline(const char * path)
+{
+    std::map<std::string, double> base;
+    char line[512], name[256], type[32];
+    double ns;
+    FILE * f = fopen(path, "r");
+
+    if (!f)
+    {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        return base;
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "{\"name\": \"%255[^\"]\", \"type\": \"%31[^\"]\", \"ns_per_op\": %lf", name, type, &ns) == 3)
+        {
+            base[std::string(name) + "/" + type] = ns;
+        }
+    }
+    fclose(f);
+    return base;
+}
+
+int
+main(int argc, char ** argv)
+{
+    const char * filter = NULL, * json = NULL, * baseline = NULL;
+    double threshold = 5;
+    PerfCounters perf;
+    std::vector<Result> results;
+    std::map<std::string, double> base;
+    int regressions = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if      (!strcmp(argv[i], "--filter")    && i + 1 < argc) filter    = argv[++i];
+        else if (!strcmp(argv[i], "--json")      && i + 1 < argc) json      = argv[++i];
+        else if (!strcmp(argv[i], "--baseline")  && i + 1 < argc) baseline  = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) threshold = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--filter substr] [--json out.json] [--baseline old.json] [--threshold pct]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (baseline) base = loadBaseline(baseline);
+    if (!perf.available()) printf("perf_event not available, cycle and instruction counts omitted\n");
+
+    suite<float>(perf, "float", filter, results);
+    suite<double>(perf, "double", filter, results);
+
+    printf("%-30s %-7s %10s %10s %10s %10s", "benchmark", "type", "ns/op", "Mop/s", "cyc/op", "ins/op");
+    if (baseline) printf(" %10s", "vs base");
+    printf("\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result & r = results[i];
+
+        printf("%-30s %-7s %10.3f %10.2f", r.name.c_str(), r.type.c_str(), r.ns, 1e3 / r.ns);
+        if (r.cycles >= 0) printf(" %10.2f %10.2f", r.cycles, r.instrs);
+        else               printf(" %10s %10s", "-", "-");
+        if (baseline)
+        {
+            std::map<std::string, double>::const_iterator b = base.find(r.name + "/" + r.type);
+
+            if (b != base.end())
+            {
+                double pct = (r.ns / b->second - 1) * 100;
+
+                printf(" %+9.1f%%%s", pct, (pct > threshold) ? "  REGRESSION" : "");
+                if (pct > threshold) regressions++;
+            }
+            else
+            {
+                printf(" %10s", "new");
+            }
+        }
+        printf("\n");
+    }
+
+    if (json)
+    {
+        FILE * f = fopen(json, "w");
+
+        if (!f)
+        {
+            fprintf(stderr, "cannot write %s\n", json);
+            return 2;
+        }
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result & r = results[i];
+
+            fprintf(f, "{\"name\": \"%s\", \"type\": \"%s\", \"ns_per_op\": %.4f, \"mops\": %.4f", r.name.c_str(), r.type.c_str(), r.ns, 1e3 / r.ns);
+            if (r.cycles >= 0) fprintf(f, ", \"cycles_per_op\": %.3f, \"instructions_per_op\": %.3f}\n", r.cycles, r.instrs);
+            else               fprintf(f, ", \"cycles_per_op\": null, \"instructions_per_op\": null}\n");
+        }
+        fclose(f);
+    }
+
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * Throughput of IMU::rotBatch() against a per-element Quaternion::rot() loop.
+ *
+ * Build and run (no build system needed):
+ *
+ *     g++ -O2 -march=native -Ilib bench/QuaternionBatchBench.cpp -o rotbench && ./rotbench [n]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include <QuaternionBatch.h>
+
+using namespace IMU;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+template <typename T>
+static void
+run(const char * name, size_t n, int reps)
+{
+    std::vector< Vector3D<T> > aos(n), out(n);
+    std::vector<T> x(n), y(n), z(n), ox(n), oy(n), oz(n);
+    Quaternion<T> q(0.9f, 0.1f, -0.3f, 0.2f);
+    double t0, t_rot, t_aos, t_soa;
+    T sink = 0;
+
+    q.normalize();
+    for (size_t i = 0; i < n; i++)
+    {
+        x[i] = (T)rand() / RAND_MAX - 0.5f;
+        y[i] = (T)rand() / RAND_MAX - 0.5f;
+        z[i] = (T)rand() / RAND_MAX - 0.5f;
+        aos[i].set(x[i], y[i], z[i]);
+    }
+
+    t0 = now();
+    for (int r = 0; r < reps; r++)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = q.rot(aos[i]);
+        sink += out[r % n].X();
+    }
+    t_rot = (now() - t0) / reps;
+
+    t0 = now();
+    for (int r = 0; r < reps; r++)
+    {
+        rotBatch(q, &aos[0], &out[0], n);
+        sink += out[r % n].X();
+    }
+    t_aos = (now() - t0) / reps;
+
+    t0 = now();
+    for (int r = 0; r < reps; r++)
+    {
+        rotBatch(q, &x[0], &y[0], &z[0], &ox[0], &oy[0], &oz[0], n);
+        sink += ox[r % n];
+    }
+    t_soa = (now() - t0) / reps;
+
+    printf("%-6s n=%-8lu rot() %8.2f Mvec/s | rotBatch AoS %8.2f Mvec/s (x%.1f) | rotBatch SoA %8.2f Mvec/s (x%.1f)   [%g]\n",
+           name, (unsigned long)n,
+           n / t_rot * 1e-6,
+           n / t_aos * 1e-6, t_rot / t_aos,
+           n / t_soa * 1e-6, t_rot / t_soa,
+           (double)sink);
+}
+
+int
+main(int argc, char ** argv)
+{
+    size_t n = (argc > 1) ? strtoul(argv[1], NULL, 0) : 100000;
+    int reps = (int)(200000000 / (n * 20) + 1);
+
+    run<float>("float", n, reps);
+    run<double>("double", n, reps);
+
+    return 0;
+}
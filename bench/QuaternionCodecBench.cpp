@@ -0,0 +1,115 @@
+/**
+ * Throughput of QuaternionCodec: one quaternion at a time through encode(),
+ * put(), get() and decode(), against the batch versions on arrays, for a few
+ * code sizes in float and double, with the rotation error of the round trip.
+ * -ffp-contract=off keeps the float batch bit identical to the scalar path
+ * (it is checked) when -march enables FMA.
+ *
+ * Build and run (no build system needed):
+ *
+ *     g++ -O2 -march=native -ffp-contract=off -Ilib bench/QuaternionCodecBench.cpp -o codecbench && ./codecbench [n]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#include <QuaternionCodec.h>
+
+using namespace IMU;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+gauss(void)
+{
+    const double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+template <int BITS, typename T>
+static void
+run(const char * name, int n)
+{
+    typedef QuaternionCodec<BITS> Codec;
+
+    std::vector< Quaternion<T> > q(n), r(n), s(n);
+    std::vector<uint8_t> code(n * Codec::BYTES), batch(n * Codec::BYTES);
+    double t0, t_enc, t_dec, t_benc, t_bdec, emax = 0, esum = 0;
+    int diff = 0;
+
+    // Uniformly distributed rotations.
+    srand(1);
+    for (int i = 0; i < n; i++)
+    {
+        q[i] = Quaternion<T>(T(gauss()), T(gauss()), T(gauss()), T(gauss()));
+        q[i].normalize();
+    }
+
+    t0 = now();
+    for (int i = 0; i < n; i++) Codec::put(Codec::encode(q[i]), &code[i * Codec::BYTES]);
+    t_enc = now() - t0;
+
+    t0 = now();
+    for (int i = 0; i < n; i++) r[i] = Codec::template decode<T>(Codec::get(&code[i * Codec::BYTES]));
+    t_dec = now() - t0;
+
+    t0 = now();
+    Codec::encode(&q[0], &batch[0], n);
+    t_benc = now() - t0;
+
+    t0 = now();
+    Codec::decode(&batch[0], &s[0], n);
+    t_bdec = now() - t0;
+
+    for (int i = 0; i < n; i++)
+    {
+        // Angle from the chord between q and the nearer of +-r, in double so
+        // float rounding of the dot product does not swamp the 48 bit error.
+        const double sg = (q[i].dot(r[i]) < 0) ? -1 : 1;
+        const double dw = q[i].W() - sg * r[i].W(), dx = q[i].X() - sg * r[i].X();
+        const double dy = q[i].Y() - sg * r[i].Y(), dz = q[i].Z() - sg * r[i].Z();
+        const double e  = 4 * asin(0.5 * sqrt(dw * dw + dx * dx + dy * dy + dz * dz));
+
+        emax = (e > emax) ? e : emax;
+        esum += e * e;
+        diff += r[i].W() != s[i].W() || r[i].X() != s[i].X() || r[i].Y() != s[i].Y() || r[i].Z() != s[i].Z();
+    }
+    diff += code != batch;
+
+    printf("%-6s %2d bits: encode %6.1f Mq/s batch %6.1f | decode %6.1f Mq/s batch %6.1f | "
+           "max err %.2e (bound %.2e) rms %.2e%s\n",
+           name, BITS,
+           n / t_enc * 1e-6, n / t_benc * 1e-6, n / t_dec * 1e-6, n / t_bdec * 1e-6,
+           emax, Codec::maxAngleError(), sqrt(esum / n), diff ? "  BATCH MISMATCH" : "");
+}
+
+template <typename T>
+static void
+runAll(const char * name, int n)
+{
+    run<29, T>(name, n);
+    run<32, T>(name, n);
+    run<40, T>(name, n);
+    run<48, T>(name, n);
+}
+
+int
+main(int argc, char ** argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+    runAll<float>("float", n);
+    runAll<double>("double", n);
+
+    return 0;
+}
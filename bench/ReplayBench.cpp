@@ -0,0 +1,107 @@
+/**
+ * Replays synthetic IMU logs through MadgwickAHRS with ReplayRunner.
+ *
+ * Writes a set of logs whose lengths vary by 100x into a scratch directory,
+ * replays them on 1 thread and on N threads, checks the per-log results are
+ * bit identical and reports throughput and steals.
+ *
+ * Build and run:
+ *
+ *     g++ -std=c++11 -O2 -march=native -pthread -Ilib bench/ReplayBench.cpp -o replaybench
+ *     ./replaybench [threads] [logs] [dir]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include <AHRS.h>
+#include <ImuLog.h>
+#include <Replay.h>
+
+using namespace IMU;
+
+typedef AttitudeReplay<float, MadgwickAHRS<float> > Job;
+
+static double
+replay(unsigned threads, const std::vector<const ImuLogReader<float> *> & logs, std::vector<Job::State> & states, uint64_t & steals)
+{
+    typedef std::chrono::steady_clock clock;
+    const Job job(&logs[0]);
+    ReplayRunner<Job> runner(threads);
+
+    states.assign(logs.size(), Job::State(MadgwickAHRS<float>(1000.0f, 0.1f)));
+
+    clock::time_point t0 = clock::now();
+    runner.run(job, logs.size(), &states[0]);
+    steals = runner.steals();
+    return std::chrono::duration<double>(clock::now() - t0).count();
+}
+
+int
+main(int argc, char ** argv)
+{
+    const unsigned threads = (argc > 1) ? atoi(argv[1]) : 0;
+    const size_t nlogs = (argc > 2) ? atoi(argv[2]) : 64;
+    const char * dir = (argc > 3) ? argv[3] : "/tmp";
+    std::vector<ImuLogReader<float> > readers(nlogs);
+    std::vector<const ImuLogReader<float> *> logs(nlogs);
+    std::vector<Job::State> ref, par;
+    uint64_t total = 0, steals;
+    char path[512];
+
+    srand(1);
+    for (size_t l = 0; l < nlogs; l++)
+    {
+        ImuLogWriter<float> w;
+        const size_t rows = 2000 + (size_t)rand() % 198000;
+
+        snprintf(path, sizeof(path), "%s/replay%03zu.imulog", dir, l);
+        if (!w.open(path, LOG_GYRO | LOG_ACCEL | LOG_MAG, 4096))
+        {
+            fprintf(stderr, "cannot write %s\n", path);
+            return 1;
+        }
+        for (size_t i = 0; i < rows; i++)
+        {
+            const float t = i * 1e-3f;
+            w.append(ImuSample<float>(i * 1000, Vector3D<float>(0.3f * sinf(t), 0.2f * cosf(0.7f * t), 0.1f),
+                                                Vector3D<float>(0.1f * sinf(t), 0.05f, 9.81f),
+                                                Vector3D<float>(20.0f, 3.0f * cosf(t), -40.0f)));
+        }
+        if (!w.close() || !readers[l].open(path))
+        {
+            fprintf(stderr, "cannot reopen %s\n", path);
+            return 1;
+        }
+        logs[l] = &readers[l];
+        total += rows;
+    }
+
+    const double t1 = replay(1, logs, ref, steals);
+    printf("%zu logs, %llu samples\n", nlogs, (unsigned long long)total);
+    printf("1 thread:   %8.3f s  %7.1f Msamples/s\n", t1, total / t1 * 1e-6);
+
+    const double tn = replay(threads, logs, par, steals);
+    ReplayRunner<Job> probe(threads);
+    printf("%u threads: %8.3f s  %7.1f Msamples/s  speedup %.2f  steals %llu\n",
+           probe.threads(), tn, total / tn * 1e-6, t1 / tn, (unsigned long long)steals);
+
+    for (size_t l = 0; l < nlogs; l++)
+    {
+        const Quaternion<float> & a = ref[l].attitude, & b = par[l].attitude;
+
+        if (memcmp(&a, &b, sizeof(a)) != 0 || ref[l].samples != par[l].samples)
+        {
+            printf("log %zu differs between runs\n", l);
+            return 1;
+        }
+        snprintf(path, sizeof(path), "%s/replay%03zu.imulog", dir, l);
+        readers[l].close();
+        remove(path);
+    }
+    printf("results identical\n");
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * Contention benchmark for SharedAttitude: one writer, eight readers.
+ *
+ * The writer publishes as fast as it can (worst case for the readers), each
+ * reader reads in a loop and checks that it never sees a torn quaternion.
+ * The same workload over a std::mutex is run for comparison.
+ *
+ * Build and run:
+ *
+ *     g++ -std=c++11 -O2 -pthread -Ilib bench/SharedAttitudeBench.cpp -o sabench && ./sabench [readers] [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <SharedAttitude.h>
+
+using namespace IMU;
+
+struct Result
+{
+    double   writes;
+    double   reads;
+    uint64_t retries;
+    uint64_t torn;
+};
+
+/** The same interface as SharedAttitude, over a mutex.
+ */
+class LockedAttitude
+{
+    public:
+
+    void publish(const Quaternion<float> & in) { std::lock_guard<std::mutex> g(m); q = in; };
+    bool tryRead(Quaternion<float> & out, Vector3D<float> &) const { std::lock_guard<std::mutex> g(m); out = q; return true; };
+
+    private:
+
+    mutable std::mutex m;
+    Quaternion<float>  q;
+};
+
+template <class Shared>
+static Result
+run(int readers, double seconds)
+{
+    Shared shared;
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> reads(0), retries(0), torn(0);
+    uint64_t writes = 0;
+    std::vector<std::thread> threads;
+
+    for (int r = 0; r < readers; r++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            Quaternion<float> q;
+            Vector3D<float>   rate;
+            uint64_t n = 0, retry = 0, bad = 0;
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                if (!shared.tryRead(q, rate))
+                {
+                    retry++;
+                    continue;
+                }
+                // The writer always publishes (k, k, k, k).
+                if (q.W() != q.X() || q.W() != q.Y() || q.W() != q.Z()) bad++;
+                n++;
+            }
+            reads += n;
+            retries += retry;
+            torn += bad;
+        }));
+    }
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point end = t0 + std::chrono::microseconds((int64_t)(seconds * 1e6));
+    while (std::chrono::steady_clock::now() < end)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            const float k = (float)(writes++ & 0xffff);
+
+            shared.publish(Quaternion<float>(k, k, k, k));
+        }
+    }
+    stop = true;
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+    double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    Result res = { writes / dt, reads / dt, retries.load(), torn.load() };
+    return res;
+}
+
+static void
+report(const char * name, const Result & r)
+{
+    printf("%-16s writes %10.3f M/s   reads %10.3f M/s   retries %12llu   torn %llu\n",
+           name, r.writes * 1e-6, r.reads * 1e-6, (unsigned long long)r.retries, (unsigned long long)r.torn);
+}
+
+int
+main(int argc, char ** argv)
+{
+    int    readers = (argc > 1) ? atoi(argv[1]) : 8;
+    double seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+
+    printf("1 writer, %d readers, %.1f s each\n", readers, seconds);
+    report("SharedAttitude", run< SharedAttitude<float> >(readers, seconds));
+    report("std::mutex", run<LockedAttitude>(readers, seconds));
+
+    return 0;
+}
@@ -0,0 +1,250 @@
+/**
+ * Strapdown throughput and accuracy at high input rates.
+ *
+ * Generates gyro/accel increments at the input rate (default 8 kHz) for two
+ * classic motions with known answers: coning (attitude) and sculling
+ * (velocity).  Integrates them with Strapdown at the navigation rate
+ * (default 200 Hz) and, as the baselines, per sample with
+ * Quaternion::operator*= and normalize(), and with UnitQuaternion (lazy,
+ * sqrt-free renormalization).  Reports ns per input sample and
+ * the final attitude and velocity errors at float and double.
+ *
+ * Build and run:
+ *
+ *     g++ -std=c++11 -O2 -march=native -Ilib bench/StrapdownBench.cpp -o strapdownbench
+ *     ./strapdownbench [input Hz] [nav Hz] [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <Strapdown.h>
+#include <UnitQuaternion.h>
+
+using namespace IMU;
+
+struct Motion
+{
+    std::vector<double> dtheta;         // 3 per sample
+    std::vector<double> dv;
+    double              q[4];           // true final attitude, w x y z
+    double              v[3];           // true final velocity
+};
+
+/** Coning: the body axis sweeps a cone of half angle th at w rad/s.  Exact increments. */
+static void
+coning(Motion & m, size_t n, double dt, double th, double w)
+{
+    const double s = sin(th / 2), c = cos(th / 2), T = n * dt;
+
+    m.dtheta.resize(3 * n);
+    m.dv.assign(3 * n, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        const double t0 = i * dt, t1 = t0 + dt;
+
+        m.dtheta[3 * i + 0] = sin(th) * (cos(w * t1) - cos(w * t0));
+        m.dtheta[3 * i + 1] = sin(th) * (sin(w * t1) - sin(w * t0));
+        m.dtheta[3 * i + 2] = -2 * w * s * s * dt;
+    }
+    // q(t) = (c, s cos wt, s sin wt, 0) starts away from identity, the integrated attitude is q(0)* q(T).
+    const Quaternion<double> q = Quaternion<double>(c, s, 0, 0).conj() * Quaternion<double>(c, s * cos(w * T), s * sin(w * T), 0);
+
+    m.q[0] = q.W(), m.q[1] = q.X(), m.q[2] = q.Y(), m.q[3] = q.Z();
+    m.v[0] = m.v[1] = m.v[2] = 0;
+}
+
+/** Sculling: roll a sin(wt) about x with specific force b sin(wt) along body y. */
+static void
+sculling(Motion & m, size_t n, double dt, double a, double b, double w)
+{
+    const double T = n * dt;
+    const size_t fine = 2000000;
+    const double h = T / fine;
+    double vy = 0, vz = 0;
+
+    m.dtheta.assign(3 * n, 0);
+    m.dv.assign(3 * n, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        const double t0 = i * dt, t1 = t0 + dt;
+
+        m.dtheta[3 * i + 0] = a * (sin(w * t1) - sin(w * t0));
+        m.dv[3 * i + 1]     = b * (cos(w * t0) - cos(w * t1)) / w;
+    }
+
+    // Truth: Simpson's rule on the navigation frame specific force.
+    for (size_t k = 0; k <= fine; k++)
+    {
+        const double t = k * h, f = b * sin(w * t), r = a * sin(w * t);
+        const double wt = (k == 0 || k == fine) ? 1 : (k & 1) ? 4 : 2;
+
+        vy += wt * f * cos(r);
+        vz += wt * f * sin(r);
+    }
+    m.v[0] = 0, m.v[1] = vy * h / 3, m.v[2] = vz * h / 3;
+    m.q[0] = cos(a * sin(w * T) / 2), m.q[1] = sin(a * sin(w * T) / 2), m.q[2] = m.q[3] = 0;
+}
+
+template <typename T>
+struct Result
+{
+    double        ns;
+    Quaternion<T> q;
+    Vector3D<T>   v;
+};
+
+template <typename T>
+static Result<T>
+naive(const std::vector<Vector3D<T> > & dth, const std::vector<Vector3D<T> > & dv)
+{
+    typedef std::chrono::steady_clock clock;
+    const size_t n = dth.size();
+    Result<T> r;
+
+    r.ns = 1e30;
+    for (int rep = 0; rep < 5; rep++)
+    {
+        Quaternion<T> q;
+        Vector3D<T> v;
+        clock::time_point t0 = clock::now();
+
+        for (size_t i = 0; i < n; i++)
+        {
+            v += q.rot(dv[i]);
+            q *= Quaternion<T>(1, dth[i].X() / 2, dth[i].Y() / 2, dth[i].Z() / 2);
+            q.normalize();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / n;
+
+        if (ns < r.ns) r.ns = ns;
+        r.q = q, r.v = v;
+    }
+    return r;
+}
+
+template <typename T>
+static Result<T>
+unit(const std::vector<Vector3D<T> > & dth, const std::vector<Vector3D<T> > & dv)
+{
+    typedef std::chrono::steady_clock clock;
+    const size_t n = dth.size();
+    Result<T> r;
+
+    r.ns = 1e30;
+    for (int rep = 0; rep < 5; rep++)
+    {
+        UnitQuaternion<T> q;
+        Vector3D<T> v;
+        clock::time_point t0 = clock::now();
+
+        for (size_t i = 0; i < n; i++)
+        {
+            v += q.rot(dv[i]);
+            q *= UnitQuaternion<T>(1, dth[i].X() / 2, dth[i].Y() / 2, dth[i].Z() / 2);
+        }
+        const double ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / n;
+
+        if (ns < r.ns) r.ns = ns;
+        r.q = q, r.v = v;
+    }
+    return r;
+}
+
+template <typename T>
+static Result<T>
+strapdown(const std::vector<Vector3D<T> > & dth, const std::vector<Vector3D<T> > & dv, T dt, size_t ratio)
+{
+    typedef std::chrono::steady_clock clock;
+    const size_t n = dth.size();
+    Result<T> r;
+
+    r.ns = 1e30;
+    for (int rep = 0; rep < 5; rep++)
+    {
+        Strapdown<T> nav((Vector3D<T>()));
+        clock::time_point t0 = clock::now();
+
+        for (size_t i = 0; i < n; i++)
+        {
+            nav.add(dth[i], dv[i], dt);
+            if ((i + 1) % ratio == 0) nav.update();
+        }
+        nav.update();
+        const double ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / n;
+
+        if (ns < r.ns) r.ns = ns;
+        r.q = nav.attitude(), r.v = nav.velocity();
+    }
+    return r;
+}
+
+/** Rotation angle between q and the true attitude, from the vector part of t* q (acos of the dot loses it). */
+template <typename T>
+static double
+angle(const Quaternion<T> & q, const double * t)
+{
+    const double w = q.W(), x = q.X(), y = q.Y(), z = q.Z();
+    const double ex = t[0] * x - t[1] * w - t[2] * z + t[3] * y;
+    const double ey = t[0] * y - t[2] * w - t[3] * x + t[1] * z;
+    const double ez = t[0] * z - t[3] * w - t[1] * y + t[2] * x;
+
+    return 2 * asin(fmin(1.0, sqrt(ex * ex + ey * ey + ez * ez)));
+}
+
+template <typename T>
+static double
+dist(const Vector3D<T> & v, const double * t)
+{
+    const double x = v.X() - t[0], y = v.Y() - t[1], z = v.Z() - t[2];
+
+    return sqrt(x * x + y * y + z * z);
+}
+
+template <typename T>
+static void
+run(const char * type, const char * name, const Motion & m, double rate, size_t ratio)
+{
+    const size_t n = m.dtheta.size() / 3;
+    std::vector<Vector3D<T> > dth(n), dv(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        dth[i].set(T(m.dtheta[3 * i]), T(m.dtheta[3 * i + 1]), T(m.dtheta[3 * i + 2]));
+        dv[i].set(T(m.dv[3 * i]), T(m.dv[3 * i + 1]), T(m.dv[3 * i + 2]));
+    }
+
+    const Result<T> a = naive(dth, dv);
+    const Result<T> u = unit(dth, dv);
+    const Result<T> b = strapdown(dth, dv, T(1 / rate), ratio);
+
+    printf("%-9s %-7s %-10s %8.2f %12.3e %12.3e\n", name, type, "per-sample", a.ns, angle(a.q, m.q), dist(a.v, m.v));
+    printf("%-9s %-7s %-10s %8.2f %12.3e %12.3e\n", name, type, "unit", u.ns, angle(u.q, m.q), dist(u.v, m.v));
+    printf("%-9s %-7s %-10s %8.2f %12.3e %12.3e\n", name, type, "strapdown", b.ns, angle(b.q, m.q), dist(b.v, m.v));
+}
+
+int
+main(int argc, char ** argv)
+{
+    const double rate = (argc > 1) ? atof(argv[1]) : 8000;
+    const double navRate = (argc > 2) ? atof(argv[2]) : 200;
+    const double seconds = (argc > 3) ? atof(argv[3]) : 10;
+    const size_t n = (size_t)(rate * seconds), ratio = (size_t)(rate / navRate + 0.5);
+    const double pi = 3.14159265358979323846;
+    Motion cone, scul;
+
+    coning(cone, n, 1 / rate, 2 * pi / 180, 2 * pi * 10);
+    sculling(scul, n, 1 / rate, 2 * pi / 180, 10, 2 * pi * 10);
+
+    printf("%.0f Hz input, %.0f Hz navigation, %.0f s, 10 Hz motion\n", rate, navRate, seconds);
+    printf("%-9s %-7s %-10s %8s %12s %12s\n", "motion", "type", "method", "ns/samp", "att err rad", "vel err m/s");
+    run<float>("float", "coning", cone, rate, ratio);
+    run<double>("double", "coning", cone, rate, ratio);
+    run<float>("float", "sculling", scul, rate, ratio);
+    run<double>("double", "sculling", scul, rate, ratio);
+    return 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * Cost of VirtualImu::fuse() against the number of sensors, next to a
+ * per-sensor Quaternion::rot() loop that only averages (no lever arm fit, no
+ * outlier rejection), and the error of both against the true motion.
+ *
+ * Build and run (no build system needed):
+ *
+ *     g++ -O2 -march=native -Ilib bench/VirtualImuBench.cpp -o vimubench && ./vimubench [epochs]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#include <VirtualImu.h>
+
+using namespace IMU;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+uniform(void)
+{
+    return (double)rand() / RAND_MAX - 0.5;
+}
+
+static double
+gauss(void)
+{
+    const double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+template <typename T>
+static Vector3D<T>
+noise(double sigma)
+{
+    return Vector3D<T>(T(sigma * gauss()), T(sigma * gauss()), T(sigma * gauss()));
+}
+
+template <typename T>
+static void
+run(const char * name, int sensors, int epochs)
+{
+    const double gs = 0.01, as = 0.05;
+    VirtualImu<T, 16> v;
+    std::vector< Quaternion<T> > mount(sensors);
+    std::vector< Vector3D<T> > lever(sensors), gyro(epochs * sensors), accel(epochs * sensors), tg(epochs), ta(epochs);
+    double t0, t_fuse, t_loop, eg = 0, ea = 0, lg = 0, la = 0;
+    T sink = 0;
+
+    srand(1);
+    for (int i = 0; i < sensors; i++)
+    {
+        mount[i] = Quaternion<T>(T(uniform()), T(uniform()), T(uniform()), T(uniform()));
+        mount[i].normalize();
+        lever[i].set(T(uniform()), T(uniform()), T(uniform()));
+        v.addSensor(mount[i], lever[i], T(gs), T(as));
+    }
+    if (sensors >= 4) v.setOutlierRejection(T(16.3), 1);
+
+    // Tumbling body, 1 kHz; one accel reading in 50 is off by 2 m/s^2.
+    for (int e = 0; e < epochs; e++)
+    {
+        const double t = e * 1e-3;
+        const Vector3D<T> w(T(2 * sin(3 * t)), T(1.5 * cos(2 * t)), T(0.5));
+        const Vector3D<T> dw(T(6 * cos(3 * t)), T(-3 * sin(2 * t)), T(0));
+        const Vector3D<T> a(T(sin(t)), T(0.3), T(9.8));
+
+        tg[e] = w, ta[e] = a;
+        for (int i = 0; i < sensors; i++)
+        {
+            const Vector3D<T> ai = a + dw.cross(lever[i]) + w.cross(w.cross(lever[i]));
+
+            gyro[e * sensors + i]  = mount[i].conj().rot(w) + noise<T>(gs);
+            accel[e * sensors + i] = mount[i].conj().rot(ai) + noise<T>(as);
+            if (rand() % 50 == 0) accel[e * sensors + i] += Vector3D<T>(T(2), T(0), T(0));
+        }
+    }
+
+    t0 = now();
+    for (int e = 0; e < epochs; e++)
+    {
+        Vector3D<T> g, a;
+
+        v.fuse(&gyro[e * sensors], &accel[e * sensors], g, a);
+        sink += a.X();
+        eg += (g - tg[e]).dot(g - tg[e]);
+        ea += (a - ta[e]).dot(a - ta[e]);
+    }
+    t_fuse = (now() - t0) / epochs;
+
+    t0 = now();
+    for (int e = 0; e < epochs; e++)
+    {
+        Vector3D<T> g, a;
+
+        for (int i = 0; i < sensors; i++) g += mount[i].rot(gyro[e * sensors + i]);
+        g *= T(1) / sensors;
+        for (int i = 0; i < sensors; i++) a += mount[i].rot(accel[e * sensors + i]) - g.cross(g.cross(lever[i]));
+        a *= T(1) / sensors;
+        sink += a.X();
+        lg += (g - tg[e]).dot(g - tg[e]);
+        la += (a - ta[e]).dot(a - ta[e]);
+    }
+    t_loop = (now() - t0) / epochs;
+
+    printf("%-6s %2d sensors: fuse() %7.1f ns  rms gyro %.2e accel %.2e | rot() loop %7.1f ns  rms gyro %.2e accel %.2e   [%g]\n",
+           name, sensors,
+           t_fuse * 1e9, sqrt(eg / epochs), sqrt(ea / epochs),
+           t_loop * 1e9, sqrt(lg / epochs), sqrt(la / epochs),
+           (double)sink);
+}
+
+int
+main(int argc, char ** argv)
+{
+    int epochs = (argc > 1) ? atoi(argv[1]) : 20000;
+    const int sensors[] = { 1, 2, 4, 8, 12, 16 };
+
+    for (size_t i = 0; i < sizeof(sensors) / sizeof(sensors[0]); i++) run<float>("float", sensors[i], epochs);
+    for (size_t i = 0; i < sizeof(sensors) / sizeof(sensors[0]); i++) run<double>("double", sensors[i], epochs);
+
+    return 0;
+}
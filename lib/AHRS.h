@@ -0,0 +1,384 @@
+#ifndef __AHRS_H__
+#define __AHRS_H__
+
+#include <stddef.h>
+#include <float.h>
+#include <math.h>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <ImuSample.h>
+#include <FastMath.h>
+
+namespace IMU
+{
+
+/** @class MadgwickAHRS
+*
+* Madgwick gradient descent attitude filter.
+*
+* Fixed rate update from gyro (rad/s), accel and optionally mag samples.  The
+* attitude uses the same convention as Quaternion<T>::gVec() and
+* getEulerAngles().  All normalizations go through rsqrt(), nothing is
+* allocated, and the batch update keeps the attitude in locals across the
+* whole run of samples.
+*/
+template <typename T>
+class MadgwickAHRS
+{
+    public:
+
+    /**
+     * Constructor.
+     *
+     * @param rate Sample rate in Hz.
+     * @param beta Gradient descent gain.
+     */
+    MadgwickAHRS(const T & rate, const T & beta) : q(), dt(1 / rate), beta(beta) {};
+
+    /** Current attitude.
+     */
+    const Quaternion<T> & attitude(void) const { return q; };
+
+    /**
+     * Restart from a given attitude.
+     *
+     * @param att Initial attitude, must be normalized.
+     */
+    void reset(const Quaternion<T> & att = Quaternion<T>()) { q = att; };
+
+    /**
+     * Process one sample.
+     *
+     * @param gyro  Angular rate in rad/s.
+     * @param accel Specific force, only the direction is used.  Zero skips the correction.
+     * @param mag   Magnetic field, only the direction is used.  Zero falls back to the accel only correction.
+     */
+    void update(const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag = Vector3D<T>());
+
+    /**
+     * Process one sample record.
+     */
+    void update(const ImuSample<T> & s) { update(s.gyro, s.accel, s.mag); };
+
+    /**
+     * Process n consecutive sample records.
+     *
+     * @param s Samples, oldest first.
+     * @param n Number of samples.
+     */
+    void update(const ImuSample<T> * s, size_t n);
+
+    protected:
+
+    void step(T & q0, T & q1, T & q2, T & q3, const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag) const;
+
+    Quaternion<T> q;
+    T             dt;
+    T             beta;
+
+}; // class MadgwickAHRS
+
+template <typename T>
+void
+MadgwickAHRS<T>::update(const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag)
+{
+    T q0 = q.W(), q1 = q.X(), q2 = q.Y(), q3 = q.Z();
+
+    step(q0, q1, q2, q3, gyro, accel, mag);
+    q.set(q0, q1, q2, q3);
+}
+
+template <typename T>
+void
+MadgwickAHRS<T>::update(const ImuSample<T> * s, size_t n)
+{
+    T q0 = q.W(), q1 = q.X(), q2 = q.Y(), q3 = q.Z();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        step(q0, q1, q2, q3, s[i].gyro, s[i].accel, s[i].mag);
+    }
+    q.set(q0, q1, q2, q3);
+}
+
+template <typename T>
+void
+MadgwickAHRS<T>::step(T & q0, T & q1, T & q2, T & q3, const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag) const
+{
+    const T zero = 0, half = T(1) / 2;
+    T gx = gyro.X(), gy = gyro.Y(), gz = gyro.Z();
+    T ax = accel.X(), ay = accel.Y(), az = accel.Z();
+    T mx = mag.X(), my = mag.Y(), mz = mag.Z();
+    T recip;
+
+    // Rate of change of quaternion from the gyro
+    T qDot0 = half * (-q1 * gx - q2 * gy - q3 * gz);
+    T qDot1 = half * ( q0 * gx + q2 * gz - q3 * gy);
+    T qDot2 = half * ( q0 * gy - q1 * gz + q3 * gx);
+    T qDot3 = half * ( q0 * gz + q1 * gy - q2 * gx);
+
+    if (!(ax == zero && ay == zero && az == zero))
+    {
+        T s0, s1, s2, s3;
+
+        recip = rsqrt(ax * ax + ay * ay + az * az);
+        ax *= recip, ay *= recip, az *= recip;
+
+        if (mx == zero && my == zero && mz == zero)
+        {
+            // Gravity only objective function gradient
+            const T _2q0 = 2 * q0, _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3;
+            const T _4q0 = 4 * q0, _4q1 = 4 * q1, _4q2 = 4 * q2;
+            const T _8q1 = 8 * q1, _8q2 = 8 * q2;
+            const T q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+            s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+            s1 = _4q1 * q3q3 - _2q3 * ax + 4 * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+            s2 = 4 * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+            s3 = 4 * q1q1 * q3 - _2q1 * ax + 4 * q2q2 * q3 - _2q2 * ay;
+        }
+        else
+        {
+            // Gravity and magnetic field objective function gradient
+            recip = rsqrt(mx * mx + my * my + mz * mz);
+            mx *= recip, my *= recip, mz *= recip;
+
+            const T _2q0mx = 2 * q0 * mx, _2q0my = 2 * q0 * my, _2q0mz = 2 * q0 * mz, _2q1mx = 2 * q1 * mx;
+            const T _2q0 = 2 * q0, _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3;
+            const T _2q0q2 = 2 * q0 * q2, _2q2q3 = 2 * q2 * q3;
+            const T q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+            const T q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+            const T q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+
+            // Reference direction of the earth's magnetic field
+            const T hx   = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+            const T hy   = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+            const T _2bx = sqrt(hx * hx + hy * hy);
+            const T _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+            const T _4bx = 2 * _2bx, _4bz = 2 * _2bz;
+
+            // Residuals of the gravity and field predictions
+            const T fgx = 2 * q1q3 - _2q0q2 - ax;
+            const T fgy = 2 * q0q1 + _2q2q3 - ay;
+            const T fgz = 1 - 2 * q1q1 - 2 * q2q2 - az;
+            const T fbx = _2bx * (half - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+            const T fby = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+            const T fbz = _2bx * (q0q2 + q1q3) + _2bz * (half - q1q1 - q2q2) - mz;
+
+            s0 = -_2q2 * fgx + _2q1 * fgy - _2bz * q2 * fbx + (-_2bx * q3 + _2bz * q1) * fby + _2bx * q2 * fbz;
+            s1 = _2q3 * fgx + _2q0 * fgy - 4 * q1 * fgz + _2bz * q3 * fbx + (_2bx * q2 + _2bz * q0) * fby + (_2bx * q3 - _4bz * q1) * fbz;
+            s2 = -_2q0 * fgx + _2q3 * fgy - 4 * q2 * fgz + (-_4bx * q2 - _2bz * q0) * fbx + (_2bx * q1 + _2bz * q3) * fby + (_2bx * q0 - _4bz * q2) * fbz;
+            s3 = _2q1 * fgx + _2q2 * fgy + (-_4bx * q3 + _2bz * q1) * fbx + (-_2bx * q0 + _2bz * q2) * fby + _2bx * q1 * fbz;
+        }
+
+        // Normalized gradient step.  The gradient vanishes when the
+        // prediction matches exactly (e.g. level and at rest), and rsqrt()
+        // must never see 0: it returns inf and the attitude turns NaN.  The
+        // double rsqrt() starts from a float estimate, so anything below
+        // FLT_MIN counts as 0 too.
+        const T n = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+
+        if (n > T(FLT_MIN))
+        {
+            recip = beta * rsqrt(n);
+            qDot0 -= recip * s0;
+            qDot1 -= recip * s1;
+            qDot2 -= recip * s2;
+            qDot3 -= recip * s3;
+        }
+    }
+
+    q0 += qDot0 * dt;
+    q1 += qDot1 * dt;
+    q2 += qDot2 * dt;
+    q3 += qDot3 * dt;
+
+    recip = rsqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 *= recip, q1 *= recip, q2 *= recip, q3 *= recip;
+}
+
+/** @class MahonyAHRS
+*
+* Mahony nonlinear complementary attitude filter.
+*
+* Proportional and integral feedback of the cross product between measured
+* and predicted gravity (and field) directions onto the gyro.  Same interface
+* and conventions as MadgwickAHRS.
+*/
+template <typename T>
+class MahonyAHRS
+{
+    public:
+
+    /**
+     * Constructor.
+     *
+     * @param rate Sample rate in Hz.
+     * @param kp   Proportional gain.
+     * @param ki   Integral gain, zero disables the gyro bias integrator.
+     */
+    MahonyAHRS(const T & rate, const T & kp, const T & ki) : q(), bias(), dt(1 / rate), twoKp(2 * kp), twoKi(2 * ki) {};
+
+    /** Current attitude.
+     */
+    const Quaternion<T> & attitude(void) const { return q; };
+
+    /** Integral feedback term (the negated gyro bias estimate), rad/s.
+     */
+    const Vector3D<T>   & integral(void) const { return bias; };
+
+    /**
+     * Restart from a given attitude, clearing the integrator.
+     *
+     * @param att Initial attitude, must be normalized.
+     */
+    void reset(const Quaternion<T> & att = Quaternion<T>()) { q = att; bias.set(0, 0, 0); };
+
+    /**
+     * Process one sample.
+     *
+     * @param gyro  Angular rate in rad/s.
+     * @param accel Specific force, only the direction is used.  Zero skips the correction.
+     * @param mag   Magnetic field, only the direction is used.  Zero falls back to the accel only correction.
+     */
+    void update(const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag = Vector3D<T>());
+
+    /**
+     * Process one sample record.
+     */
+    void update(const ImuSample<T> & s) { update(s.gyro, s.accel, s.mag); };
+
+    /**
+     * Process n consecutive sample records.
+     *
+     * @param s Samples, oldest first.
+     * @param n Number of samples.
+     */
+    void update(const ImuSample<T> * s, size_t n);
+
+    protected:
+
+    void step(T & q0, T & q1, T & q2, T & q3, T & ix, T & iy, T & iz, const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag) const;
+
+    Quaternion<T> q;
+    Vector3D<T>   bias;
+    T             dt;
+    T             twoKp;
+    T             twoKi;
+
+}; // class MahonyAHRS
+
+template <typename T>
+void
+MahonyAHRS<T>::update(const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag)
+{
+    T q0 = q.W(), q1 = q.X(), q2 = q.Y(), q3 = q.Z();
+    T ix = bias.X(), iy = bias.Y(), iz = bias.Z();
+
+    step(q0, q1, q2, q3, ix, iy, iz, gyro, accel, mag);
+    q.set(q0, q1, q2, q3);
+    bias.set(ix, iy, iz);
+}
+
+template <typename T>
+void
+MahonyAHRS<T>::update(const ImuSample<T> * s, size_t n)
+{
+    T q0 = q.W(), q1 = q.X(), q2 = q.Y(), q3 = q.Z();
+    T ix = bias.X(), iy = bias.Y(), iz = bias.Z();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        step(q0, q1, q2, q3, ix, iy, iz, s[i].gyro, s[i].accel, s[i].mag);
+    }
+    q.set(q0, q1, q2, q3);
+    bias.set(ix, iy, iz);
+}
+
+template <typename T>
+void
+MahonyAHRS<T>::step(T & q0, T & q1, T & q2, T & q3, T & ix, T & iy, T & iz, const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag) const
+{
+    const T zero = 0, half = T(1) / 2;
+    T gx = gyro.X(), gy = gyro.Y(), gz = gyro.Z();
+    T ax = accel.X(), ay = accel.Y(), az = accel.Z();
+    T mx = mag.X(), my = mag.Y(), mz = mag.Z();
+    T recip;
+
+    if (!(ax == zero && ay == zero && az == zero))
+    {
+        const T q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+        const T q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+        const T q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+
+        // Half the predicted gravity direction, see Quaternion<T>::gVec()
+        const T halfvx = q1q3 - q0q2;
+        const T halfvy = q0q1 + q2q3;
+        const T halfvz = q0q0 - half + q3q3;
+        T halfex, halfey, halfez;
+
+        recip = rsqrt(ax * ax + ay * ay + az * az);
+        ax *= recip, ay *= recip, az *= recip;
+
+        halfex = ay * halfvz - az * halfvy;
+        halfey = az * halfvx - ax * halfvz;
+        halfez = ax * halfvy - ay * halfvx;
+
+        if (!(mx == zero && my == zero && mz == zero))
+        {
+            recip = rsqrt(mx * mx + my * my + mz * mz);
+            mx *= recip, my *= recip, mz *= recip;
+
+            // Reference direction of the earth's magnetic field
+            const T hx = 2 * (mx * (half - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+            const T hy = 2 * (mx * (q1q2 + q0q3) + my * (half - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+            const T bx = sqrt(hx * hx + hy * hy);
+            const T bz = 2 * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (half - q1q1 - q2q2));
+
+            // Half the predicted field direction
+            const T halfwx = bx * (half - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+            const T halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+            const T halfwz = bx * (q0q2 + q1q3) + bz * (half - q1q1 - q2q2);
+
+            halfex += my * halfwz - mz * halfwy;
+            halfey += mz * halfwx - mx * halfwz;
+            halfez += mx * halfwy - my * halfwx;
+        }
+
+        if (twoKi > zero)
+        {
+            ix += twoKi * halfex * dt;
+            iy += twoKi * halfey * dt;
+            iz += twoKi * halfez * dt;
+            gx += ix, gy += iy, gz += iz;
+        }
+        else
+        {
+            ix = iy = iz = zero;
+        }
+
+        gx += twoKp * halfex;
+        gy += twoKp * halfey;
+        gz += twoKp * halfez;
+    }
+
+    // Integrate the rate of change of quaternion
+    {
+        const T hdt = half * dt;
+        const T qa = q0, qb = q1, qc = q2;
+
+        gx *= hdt, gy *= hdt, gz *= hdt;
+        q0 += -qb * gx - qc * gy - q3 * gz;
+        q1 +=  qa * gx + qc * gz - q3 * gy;
+        q2 +=  qa * gy - qb * gz + q3 * gx;
+        q3 +=  qa * gz + qb * gy - qc * gx;
+    }
+
+    recip = rsqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 *= recip, q1 *= recip, q2 *= recip, q3 *= recip;
+}
+
+}; // namespace IMU
+
+#endif //__AHRS_H__
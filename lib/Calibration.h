@@ -0,0 +1,402 @@
+#ifndef __CALIBRATION_H__
+#define __CALIBRATION_H__
+
+#include <stddef.h>
+
+#include <MathPolicy.h>
+#include <Vector3D.h>
+#include <QuaternionBatch.h>
+
+namespace IMU
+{
+
+/** @class SensorCalibration
+*
+* Hard and soft iron correction of a 3 axis sensor: v' = W * (v - bias).
+*
+* W is symmetric (row-major).  The identity with zero bias leaves readings
+* unchanged.
+*/
+template <typename T>
+class SensorCalibration
+{
+    public:
+
+    /** Default constructor, no correction.
+     */
+    SensorCalibration(void) : bias() { for (int i = 0; i < 9; i++) m[i] = (i % 4 == 0) ? T(1) : T(0); };
+
+    /**
+     * Construct from bias and a row-major 3x3 matrix.
+     */
+    SensorCalibration(const Vector3D<T> & bias, const T * w) __attribute__((__nonnull__)) : bias(bias) { for (int i = 0; i < 9; i++) m[i] = w[i]; };
+
+    const Vector3D<T> & getBias(void)   const { return bias; };
+    const T           * getMatrix(void) const { return m; };
+
+    /** Correct one reading.
+     */
+    Vector3D<T> apply(const Vector3D<T> & v) const
+    {
+        const T x = v.X() - bias.X(), y = v.Y() - bias.Y(), z = v.Z() - bias.Z();
+
+        return Vector3D<T>(m[0] * x + m[1] * y + m[2] * z,
+                           m[3] * x + m[4] * y + m[5] * z,
+                           m[6] * x + m[7] * y + m[8] * z);
+    };
+
+    /**
+     * Correct n SoA readings.  W is applied with the rotBatch kernels and
+     * W * bias subtracted afterwards, a block at a time while it is in cache.
+     *
+     * @param x, y, z    Input components.
+     * @param ox, oy, oz Output components (may be the inputs).
+     * @param n          Number of readings.
+     */
+    void apply(const T * x, const T * y, const T * z, T * ox, T * oy, T * oz, size_t n) const
+    {
+        static const size_t BLOCK = 256;
+        const Vector3D<T> wb = SensorCalibration<T>(Vector3D<T>(), m).apply(bias);
+
+        for (size_t base = 0; base < n; base += BLOCK)
+        {
+            const size_t len = (n - base < BLOCK) ? n - base : BLOCK;
+            T * bx = ox + base, * by = oy + base, * bz = oz + base;
+
+            detail::rot3x3(m, x + base, y + base, z + base, bx, by, bz, len);
+            for (size_t i = 0; i < len; i++)
+            {
+                bx[i] -= wb.X(), by[i] -= wb.Y(), bz[i] -= wb.Z();
+            }
+        }
+    }
+
+    /**
+     * Correct an array of n Vector3D<T> (out may be in).
+     */
+    void apply(const Vector3D<T> * in, Vector3D<T> * out, size_t n) const
+    {
+        const Vector3D<T> wb = SensorCalibration<T>(Vector3D<T>(), m).apply(bias);
+
+        detail::rot3x3(m, in, out, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            out[i] -= wb;
+        }
+    }
+
+    private:
+
+    Vector3D<T> bias;
+    T           m[9];
+}; // class SensorCalibration
+
+namespace detail
+{
+
+/**
+ * In place Cholesky solve of the n x n SPD system A x = b (A row-major,
+ * only the lower triangle is used).  false if A is not positive definite.
+ */
+inline bool
+cholSolve(double * a, double * b, int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        double d = a[j * n + j];
+
+        for (int k = 0; k < j; k++) d -= a[j * n + k] * a[j * n + k];
+        if (!(d > 0)) return false;
+        d = math::sqrt(d);
+        a[j * n + j] = d;
+        for (int i = j + 1; i < n; i++)
+        {
+            double s = a[i * n + j];
+
+            for (int k = 0; k < j; k++) s -= a[i * n + k] * a[j * n + k];
+            a[i * n + j] = s / d;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        for (int k = 0; k < i; k++) b[i] -= a[i * n + k] * b[k];
+        b[i] /= a[i * n + i];
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        for (int k = i + 1; k < n; k++) b[i] -= a[k * n + i] * b[k];
+        b[i] /= a[i * n + i];
+    }
+    return true;
+}
+
+/**
+ * Cyclic Jacobi eigendecomposition of a symmetric 3x3 matrix.
+ *
+ * @param a   Row-major input, destroyed (eigenvalues end up on the diagonal).
+ * @param v   Output, eigenvectors in the columns.
+ * @param l   Output, eigenvalues.
+ */
+inline void
+jacobi3(double * a, double * v, double * l)
+{
+    for (int i = 0; i < 9; i++) v[i] = (i % 4 == 0) ? 1 : 0;
+
+    for (int sweep = 0; sweep < 50; sweep++)
+    {
+        const double off = a[1] * a[1] + a[2] * a[2] + a[5] * a[5];
+
+        if (off < 1e-30 * (a[0] * a[0] + a[4] * a[4] + a[8] * a[8])) break;
+
+        for (int p = 0; p < 2; p++)
+        {
+            for (int q = p + 1; q < 3; q++)
+            {
+                const double apq = a[p * 3 + q];
+
+                if (apq == 0) continue;
+
+                const double theta = (a[q * 3 + q] - a[p * 3 + p]) / (2 * apq);
+                const double t = ((theta >= 0) ? 1 : -1) / (math::fabs(theta) + math::sqrt(theta * theta + 1));
+                const double c = 1 / math::sqrt(t * t + 1), s = t * c;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    const double akp = a[k * 3 + p], akq = a[k * 3 + q];
+                    a[k * 3 + p] = c * akp - s * akq;
+                    a[k * 3 + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    const double apk = a[p * 3 + k], aqk = a[q * 3 + k];
+                    a[p * 3 + k] = c * apk - s * aqk;
+                    a[q * 3 + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    const double vkp = v[k * 3 + p], vkq = v[k * 3 + q];
+                    v[k * 3 + p] = c * vkp - s * vkq;
+                    v[k * 3 + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    l[0] = a[0], l[1] = a[4], l[2] = a[8];
+}
+
+}; // namespace detail
+
+/** @class EllipsoidFit
+*
+* Streaming least squares ellipsoid fit for magnetometer or accelerometer
+* calibration.
+*
+* Each reading adds its row d = [x², y², z², 2xy, 2xz, 2yz, 2x, 2y, 2z] of
+* the algebraic fit d . p = 1 to the 9x9 normal equations, so memory is
+* constant however long the capture.  Sums are kept in double.  Readings are
+* divided by the scale given to the constructor (roughly the expected field
+* magnitude) to keep the fourth-order sums well conditioned.
+*
+* Accumulation is not synchronised; give every thread its own EllipsoidFit
+* and merge() them afterwards.  Up to rounding the result does not depend
+* on how the readings were split.
+*/
+template <typename T>
+class EllipsoidFit
+{
+    public:
+
+    /**
+     * @param scale Typical magnitude of the readings (e.g. 1 for g, 50 for uT).
+     */
+    explicit EllipsoidFit(T scale = T(1)) : inv(1 / (double)scale) { reset(); };
+
+    /** Forget all readings.
+     */
+    void reset(void)
+    {
+        for (int i = 0; i < 45; i++) ata[i] = 0;
+        for (int i = 0; i < 9; i++)  atb[i] = 0;
+        n = 0;
+    }
+
+    /** Add one reading.
+     */
+    void add(const Vector3D<T> & v) { add((double)v.X(), (double)v.Y(), (double)v.Z()); };
+
+    /** Add n SoA readings.
+     */
+    void add(const T * x, const T * y, const T * z, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) add((double)x[i], (double)y[i], (double)z[i]);
+    }
+
+    /** Add an array of n readings.
+     */
+    void add(const Vector3D<T> * v, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) add(v[i]);
+    }
+
+    /**
+     * Fold in the readings of another accumulator with the same scale.
+     */
+    EllipsoidFit<T> & merge(const EllipsoidFit<T> & rhs)
+    {
+        for (int i = 0; i < 45; i++) ata[i] += rhs.ata[i];
+        for (int i = 0; i < 9; i++)  atb[i] += rhs.atb[i];
+        n += rhs.n;
+        return *this;
+    }
+
+    /** Number of readings so far.
+     */
+    size_t count(void) const { return (size_t)n; };
+
+    /**
+     * Solve for bias and soft iron matrix.
+     *
+     * @param cal    Output calibration.
+     * @param radius Magnitude corrected readings should have; 0 keeps the
+     *               geometric mean of the ellipsoid's semi-axes.
+     *
+     * @return false if there are too few readings or they do not lie on an
+     *         ellipsoid (too little orientation coverage); cal is untouched.
+     */
+    bool solve(SensorCalibration<T> & cal, T radius = T(0)) const
+    {
+        double a[81], p[9];
+
+        if (n < 9) return false;
+        unpack(a);
+        for (int i = 0; i < 9; i++) p[i] = atb[i];
+        if (!detail::cholSolve(a, p, 9)) return false;
+
+        // Quadric x' M x + 2 u' x = 1  ->  (x - c)' M (x - c) = 1 + c' M c, c = -M^-1 u.
+        double M[9] = { p[0], p[3], p[4], p[3], p[1], p[5], p[4], p[5], p[2] };
+        double c[3] = { -p[6], -p[7], -p[8] }, Mc[9], k, V[9], l[3];
+
+        for (int i = 0; i < 9; i++) Mc[i] = M[i];
+        if (!detail::cholSolve(Mc, c, 3)) return false;
+        k = 1 + c[0] * (M[0] * c[0] + M[1] * c[1] + M[2] * c[2])
+              + c[1] * (M[3] * c[0] + M[4] * c[1] + M[5] * c[2])
+              + c[2] * (M[6] * c[0] + M[7] * c[1] + M[8] * c[2]);
+        if (!(k > 0)) return false;
+
+        // Q = M / k = V diag(l) V';  W = r * V diag(sqrt(l)) V'.
+        for (int i = 0; i < 9; i++) Mc[i] = M[i] / k;
+        detail::jacobi3(Mc, V, l);
+        if (!(l[0] > 0 && l[1] > 0 && l[2] > 0)) return false;
+
+        const double r = (radius > 0) ? (double)radius * inv : math::pow(l[0] * l[1] * l[2], -1.0 / 6);
+        T w[9];
+
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                double s = 0;
+
+                for (int e = 0; e < 3; e++) s += V[i * 3 + e] * math::sqrt(l[e]) * V[j * 3 + e];
+                w[i * 3 + j] = (T)(r * s);
+            }
+        }
+        cal = SensorCalibration<T>(Vector3D<T>((T)(c[0] / inv), (T)(c[1] / inv), (T)(c[2] / inv)), w);
+        return true;
+    }
+
+    /**
+     * Hard iron only: fit a sphere (bias and radius), W is a uniform scale.
+     *
+     * Needs much less orientation coverage than solve().  Uses the same sums.
+     *
+     * @param radius As for solve(); 0 keeps the fitted sphere radius.
+     */
+    bool solveSphere(SensorCalibration<T> & cal, T radius = T(0)) const
+    {
+        // |x|^2 = 2 c . x + k, rows [2x, 2y, 2z, 1]; all moments are in the ellipsoid sums.
+        double a[16] = { 0 }, p[4];
+
+        if (n < 4) return false;
+        a[0]  = 4 * atb[0];
+        a[4]  = 2 * atb[3],  a[5]  = 4 * atb[1];
+        a[8]  = 2 * atb[4],  a[9]  = 2 * atb[5],  a[10] = 4 * atb[2];
+        a[12] = atb[6],      a[13] = atb[7],      a[14] = atb[8],      a[15] = n;
+        for (int i = 0; i < 3; i++)
+        {
+            p[i] = at(0, 6 + i) + at(1, 6 + i) + at(2, 6 + i);   // sum 2 x_i |x|^2
+        }
+        p[3] = atb[0] + atb[1] + atb[2];
+        if (!detail::cholSolve(a, p, 4)) return false;
+
+        const double r2 = p[3] + p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+
+        if (!(r2 > 0)) return false;
+
+        const T s = (T)((radius > 0) ? (double)radius * inv / math::sqrt(r2) : 1);
+        const T w[9] = { s, 0, 0, 0, s, 0, 0, 0, s };
+
+        cal = SensorCalibration<T>(Vector3D<T>((T)(p[0] / inv), (T)(p[1] / inv), (T)(p[2] / inv)), w);
+        return true;
+    }
+
+    /**
+     * RMS algebraic residual of the ellipsoid fit, |d . p - 1|, for judging
+     * coverage and noise.  Negative if solve() would fail.
+     */
+    double residual(void) const
+    {
+        double a[81], p[9], s;
+
+        if (n < 9) return -1;
+        unpack(a);
+        for (int i = 0; i < 9; i++) p[i] = atb[i];
+        if (!detail::cholSolve(a, p, 9)) return -1;
+
+        // sum (d.p - 1)^2 = p' A p - 2 b' p + n, and A p = b at the solution.
+        s = n;
+        for (int i = 0; i < 9; i++) s -= atb[i] * p[i];
+        return math::sqrt((s > 0 ? s : 0) / n);
+    }
+
+    private:
+
+    void add(double x, double y, double z)
+    {
+        x *= inv, y *= inv, z *= inv;
+
+        const double d[9] = { x * x, y * y, z * z, 2 * x * y, 2 * x * z, 2 * y * z, 2 * x, 2 * y, 2 * z };
+        int k = 0;
+
+        for (int i = 0; i < 9; i++)
+        {
+            for (int j = i; j < 9; j++) ata[k++] += d[i] * d[j];
+            atb[i] += d[i];
+        }
+        n += 1;
+    }
+
+    /** Element (i, j) of the packed upper triangle.
+     */
+    double at(int i, int j) const
+    {
+        if (i > j) { int t = i; i = j; j = t; }
+        return ata[i * 9 - i * (i - 1) / 2 + (j - i)];
+    }
+
+    void unpack(double * a) const
+    {
+        for (int i = 0; i < 9; i++)
+            for (int j = 0; j < 9; j++)
+                a[i * 9 + j] = at(i, j);
+    }
+
+    double inv;
+    double ata[45];
+    double atb[9];
+    double n;
+}; // class EllipsoidFit
+
+}; // namespace IMU
+
+#endif //__CALIBRATION_H__
@@ -4,56 +4,109 @@
 #include <iostream>
 #include <math.h>
 
+#include <MathPolicy.h>
+#include <Telemetry.h>
+
 namespace IMU
 {
 
-template <typename T>
+/** @class Dual
+*
+* Dual number real + epsilon e with e^2 = 0, for forward mode derivatives.
+*
+* M is the math policy (see MathPolicy.h) used by the transcendental
+* functions.  The default PreciseMath keeps Dual<float> on the float
+* functions; ApproxMath trades a documented error for speed.
+*/
+template <typename T, class M = PreciseMath>
 class Dual
 {
     public:
     // Constructors
-    Dual(void)              : real(0.0f), epsilon(0.0f)    {};
-    Dual(T real)            : real(real), epsilon(0.0f)    {};
+    Dual(void)              : real(0), epsilon(0)          {};
+    Dual(T real)            : real(real), epsilon(0)       {};
     Dual(T real, T epsilon) : real(real), epsilon(epsilon) {};
 
-    Dual<T>   conj(void) const { Dual<T> tmp(real, -epsilon); return tmp; };
-    Dual<T>   inv(void)  const;
+    Dual<T, M>   conj(void) const { Dual<T, M> tmp(real, -epsilon); return tmp; };
+    Dual<T, M>   inv(void)  const;
     T         norm(void)  const;
 
     // Arithmetic Operators
-    Dual<T> & operator +(void) { return *this; };
-    Dual<T>   operator -(void);
-
-    Dual<T>   operator *(const Dual<T> & rhs);
-
-    Dual<T> & operator +=(const Dual<T> & rhs);
-    Dual<T> & operator -=(const Dual<T> & rhs);
-    Dual<T> & operator *=(const Dual<T> & rhs);
-    Dual<T> & operator /=(const Dual<T> & rhs);
-
-    Dual<T> & operator +=(const T & rhs);
-    Dual<T> & operator -=(const T & rhs);
-    Dual<T> & operator *=(const T & rhs);
-    Dual<T> & operator /=(const T & rhs);
-
-    // math.h stuff  These should probably all be external "friend" functions..
-    Dual<T>   exp(void) const { Dual<T> tmp(exp(real), exp(real) * epsilon); return tmp; };
-    Dual<T>   log(void) const { Dual<T> tmp(log(real), epsilon/real); return tmp; };
-    Dual<T>   log10(void) const { Dual<T> tmp = this->log() / ::log(10); return tmp; };
-    Dual<T>   pow(const T & rhs) const;
-    Dual<T>   pow(const Dual<T> & rhs) const;
-    Dual<T>   sqrt(void) const;
+    Dual<T, M> & operator +(void) { return *this; };
+    Dual<T, M>   operator -(void) const;
+
+    Dual<T, M> & operator +=(const Dual<T, M> & rhs);
+    Dual<T, M> & operator -=(const Dual<T, M> & rhs);
+    Dual<T, M> & operator *=(const Dual<T, M> & rhs);
+    Dual<T, M> & operator /=(const Dual<T, M> & rhs);
+
+    Dual<T, M> & operator +=(const T & rhs);
+    Dual<T, M> & operator -=(const T & rhs);
+    Dual<T, M> & operator *=(const T & rhs);
+    Dual<T, M> & operator /=(const T & rhs);
+
+    // Binary operators.  Friends so a plain T converts on either side.
+    friend Dual<T, M> operator +(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = lhs; res += rhs; return res; };
+    friend Dual<T, M> operator -(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = lhs; res -= rhs; return res; };
+    friend Dual<T, M> operator *(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = lhs; res *= rhs; return res; };
+    friend Dual<T, M> operator /(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = lhs; res /= rhs; return res; };
+
+    friend Dual<T, M> operator +(const Dual<T, M> & lhs, const T & rhs) { Dual<T, M> res = lhs; res += rhs; return res; };
+    friend Dual<T, M> operator -(const Dual<T, M> & lhs, const T & rhs) { Dual<T, M> res = lhs; res -= rhs; return res; };
+    friend Dual<T, M> operator *(const Dual<T, M> & lhs, const T & rhs) { Dual<T, M> res = lhs; res *= rhs; return res; };
+    friend Dual<T, M> operator /(const Dual<T, M> & lhs, const T & rhs) { Dual<T, M> res = lhs; res /= rhs; return res; };
+
+    friend Dual<T, M> operator +(const T & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = rhs; res += lhs; return res; };
+    friend Dual<T, M> operator -(const T & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = -rhs; res += lhs; return res; };
+    friend Dual<T, M> operator *(const T & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = rhs; res *= lhs; return res; };
+    friend Dual<T, M> operator /(const T & lhs, const Dual<T, M> & rhs) { Dual<T, M> res = rhs.inv(); res *= lhs; return res; };
+
+    // Comparisons look at the real part only, so branches in templated code behave as they do for T.
+    friend bool    operator ==(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { return lhs.real == rhs.real; };
+    friend bool    operator !=(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { return lhs.real != rhs.real; };
+    friend bool    operator < (const Dual<T, M> & lhs, const Dual<T, M> & rhs) { return lhs.real <  rhs.real; };
+    friend bool    operator <=(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { return lhs.real <= rhs.real; };
+    friend bool    operator > (const Dual<T, M> & lhs, const Dual<T, M> & rhs) { return lhs.real >  rhs.real; };
+    friend bool    operator >=(const Dual<T, M> & lhs, const Dual<T, M> & rhs) { return lhs.real >= rhs.real; };
+
+    // math.h stuff
+    Dual<T, M>   exp(void) const { T e = M::exp(real); Dual<T, M> tmp(e, e * epsilon); return tmp; };
+    Dual<T, M>   log(void) const { Dual<T, M> tmp(M::log(real), epsilon/real); return tmp; };
+    Dual<T, M>   log10(void) const { Dual<T, M> tmp = this->log() / M::log(T(10)); return tmp; };
+    Dual<T, M>   pow(const T & rhs) const;
+    Dual<T, M>   pow(const Dual<T, M> & rhs) const;
+    Dual<T, M>   sqrt(void) const;
     T         abs(void) const { return norm(); };
 //              T         real(void) const; // Need to fix private var names before I can do this...
     T         imag(void) const { return epsilon; };
 
-    Dual<T>   sin(void) const;
-    Dual<T>   cos(void) const;
-    Dual<T>   tan(void) const;
+    Dual<T, M>   sin(void) const;
+    Dual<T, M>   cos(void) const;
+    Dual<T, M>   tan(void) const;
+
+    // The same as free functions, so Dual<T, M> can be the T of Vector3D<T> and Quaternion<T>.
+    friend Dual<T, M> exp  (const Dual<T, M> & x)                     { return x.exp(); };
+    friend Dual<T, M> log  (const Dual<T, M> & x)                     { return x.log(); };
+    friend Dual<T, M> log10(const Dual<T, M> & x)                     { return x.log10(); };
+    friend Dual<T, M> pow  (const Dual<T, M> & x, const T & y)        { return x.pow(y); };
+    friend Dual<T, M> pow  (const Dual<T, M> & x, const Dual<T, M> & y)  { return x.pow(y); };
+    friend Dual<T, M> sqrt (const Dual<T, M> & x)                     { return x.sqrt(); };
+    friend Dual<T, M> sin  (const Dual<T, M> & x)                     { return x.sin(); };
+    friend Dual<T, M> cos  (const Dual<T, M> & x)                     { return x.cos(); };
+    friend Dual<T, M> tan  (const Dual<T, M> & x)                     { return x.tan(); };
+    friend Dual<T, M> fabs (const Dual<T, M> & x)                     { return (x.real < 0) ? -x : x; };
+    friend Dual<T, M> asin (const Dual<T, M> & x)
+    {
+        return Dual<T, M>(M::asin(x.real), x.epsilon * M::rsqrt(1 - x.real * x.real));
+    };
+    friend Dual<T, M> atan2(const Dual<T, M> & y, const Dual<T, M> & x)
+    {
+        T den = x.real * x.real + y.real * y.real;
 
+        return Dual<T, M>(M::atan2(y.real, x.real), (x.real * y.epsilon - y.real * x.epsilon) / den);
+    };
 
-    //friend Dual<T> operator -(const T & lhs, const Dual<T> & rhs);
-    template <class D> friend std::ostream & operator <<(std::ostream & out, const Dual<D> & rhs);
+    template <class D, class P> friend std::ostream & operator <<(std::ostream & out, const Dual<D, P> & rhs);
 
 
 
@@ -64,11 +117,11 @@ class Dual
 
 }; // Class Dual
 
-template <typename T>
-Dual<T>
-Dual<T>::inv(void) const
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::inv(void) const
 { 
-    Dual<T> tmp; 
+    Dual<T, M> tmp; 
     
     tmp.real    =  real    / (real * real);
     tmp.epsilon = -epsilon / (real * real);
@@ -76,30 +129,18 @@ Dual<T>::inv(void) const
     return tmp;
 };
 
-template <typename T>
-Dual<T>
-Dual<T>::operator -(void)
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::operator -(void) const
 {
-    Dual<T> tmp(-real, -epsilon);
+    Dual<T, M> tmp(-real, -epsilon);
 
     return tmp;
 }
 
-template <typename T>
-Dual<T>
-Dual<T>::operator *(const Dual<T> & rhs)
-{
-    Dual<T> tmp;
-    
-    tmp.real    = real * rhs.real;
-    tmp.epsilon = real * rhs.epsilon + epsilon * rhs.real;
-
-    return tmp;
-}
-
-template <typename T>
-Dual<T> & 
-Dual<T>::operator +=(const Dual<T> & rhs) 
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator +=(const Dual<T, M> & rhs) 
 { 
     real    += rhs.real;
     epsilon += rhs.epsilon; 
@@ -107,9 +148,9 @@ Dual<T>::operator +=(const Dual<T> & rhs)
     return *this; 
 }
 
-template <typename T>
-Dual<T> & 
-Dual<T>::operator -=(const Dual<T> & rhs) 
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator -=(const Dual<T, M> & rhs) 
 { 
     real    -= rhs.real;
     epsilon -= rhs.epsilon; 
@@ -117,47 +158,47 @@ Dual<T>::operator -=(const Dual<T> & rhs)
     return *this;
 }
 
-template <typename T>
-Dual<T> & 
-Dual<T>::operator *=(const Dual<T> & rhs) 
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator *=(const Dual<T, M> & rhs) 
 { 
-    real    *= rhs.real;
     epsilon  = real * rhs.epsilon + epsilon * rhs.real; 
+    real    *= rhs.real;
     
     return *this;
 }
 
-template <typename T>
-Dual<T> & 
-Dual<T>::operator /=(const Dual<T> & rhs) 
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator /=(const Dual<T, M> & rhs) 
 {
-    real     = real / rhs.real;
     epsilon  = ( epsilon * rhs.real - real * rhs.epsilon ) / (rhs.real * rhs.real);
+    real     = real / rhs.real;
 
     return *this;
 }
 
-template <typename T>
-Dual<T> & 
-Dual<T>::operator +=(const T & rhs) 
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator +=(const T & rhs) 
 { 
-    real    += rhs.real;
+    real    += rhs;
     
     return *this; 
 }
 
-template <typename T>
-Dual<T> & 
-Dual<T>::operator -=(const T & rhs) 
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator -=(const T & rhs) 
 { 
-    real    -= rhs.real;
+    real    -= rhs;
     
     return *this;
 }
 
-template <typename T>
-Dual<T> & 
-Dual<T>::operator *=(const T & rhs) 
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator *=(const T & rhs) 
 { 
     real    *= rhs;
     epsilon *= rhs; 
@@ -165,79 +206,116 @@ Dual<T>::operator *=(const T & rhs)
     return *this;
 }
 
-template <typename T>
-Dual<T>
-Dual<T>::pow(const T & rhs) const
+template <typename T, class M>
+Dual<T, M> & 
+Dual<T, M>::operator /=(const T & rhs) 
+{ 
+    real    /= rhs;
+    epsilon /= rhs; 
+    
+    return *this;
+}
+
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::pow(const T & rhs) const
 {
     static const T min_real = 1e-15;
     T real_checked;
     T epsilon_mul;
-    Dual<T> tmp;
+    Dual<T, M> tmp;
 
     real_checked = real;
 #if 1
-    if (fabs(real_checked) < min_real)
+    if (M::fabs(real_checked) < min_real)
     {
+                    IMU_TELEMETRY_HOOK(count(TELEMETRY_DUAL_POW_CLAMP));
                     if (real_checked >= 0) real_checked =  min_real;
                     if (real_checked <  0) real_checked = -min_real;
     }
 #endif
-    epsilon_mul = rhs * powl(real_checked, (rhs - 1));
+    epsilon_mul = rhs * M::pow(real_checked, (rhs - 1));
 
-    tmp.real    = powl(real, rhs);
+    tmp.real    = M::pow(real, rhs);
     tmp.epsilon = epsilon * epsilon_mul;
 
     return tmp;
 }
 
-template <typename T>
-Dual<T>
-Dual<T>::pow(const Dual<T> & rhs) const
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::pow(const Dual<T, M> & rhs) const
 {
     static const T min_real = 1e-15;
     T real_checked;
     T epsilon_mul;
     T epsilon_add;
-    Dual<T> tmp;
+    Dual<T, M> tmp;
 
     real_checked = real;
 #if 1
-    if (fabs(real_checked) < min_real)
+    if (M::fabs(real_checked) < min_real)
     {
+                    IMU_TELEMETRY_HOOK(count(TELEMETRY_DUAL_POW_CLAMP));
                     if (real_checked >= 0) real_checked =  min_real;
                     if (real_checked <  0) real_checked = -min_real;
     }
 #endif
-    epsilon_mul = rhs.real * powl(real_checked, (rhs.real - 1));
-    epsilon_add = rhs.epsilon * ::powl(real_checked, rhs.real) * ::logl(real);
+    epsilon_mul = rhs.real * M::pow(real_checked, (rhs.real - 1));
+    // d/dy x^y = x^y log(x), from the clamped x too: at x = 0 the unclamped
+    // 0 * log(0) is NaN even for a constant exponent.
+    epsilon_add = (rhs.epsilon != 0) ? rhs.epsilon * M::pow(real_checked, rhs.real) * M::log(real_checked) : T(0);
 
-    tmp.real    = powl(real, rhs.real);
+    tmp.real    = M::pow(real, rhs.real);
     tmp.epsilon = epsilon * epsilon_mul + epsilon_add;
 
     return tmp;
 }
 
-template <typename T>
-Dual<T>
-Dual<T>::sqrt(void) const
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::sqrt(void) const
 {
-    Dual<T> tmp;
+    Dual<T, M> tmp;
 
-    tmp.real = ::sqrtl(real);
-    tmp.epsilon = epsilon / (2 * ::sqrtl(real));
+    tmp.real = M::sqrt(real);
+    tmp.epsilon = epsilon / (2 * tmp.real);
 
     return tmp;
 }
 
-template <typename T>
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::sin(void) const
+{
+    return Dual<T, M>(M::sin(real), epsilon * M::cos(real));
+}
+
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::cos(void) const
+{
+    return Dual<T, M>(M::cos(real), -epsilon * M::sin(real));
+}
+
+template <typename T, class M>
+Dual<T, M>
+Dual<T, M>::tan(void) const
+{
+    T t = M::tan(real);
+
+    return Dual<T, M>(t, epsilon * (1 + t * t));
+}
+
+template <typename T, class M>
 T
-Dual<T>::norm(void) const
+Dual<T, M>::norm(void) const
 {
-    return ::sqrtl(real*real + epsilon*epsilon);
+    return M::sqrt(real*real + epsilon*epsilon);
 }
 
-template <typename T> 
-std::ostream & operator <<(std::ostream & out, const Dual<T> & rhs)
+template <typename T, class M> 
+std::ostream & operator <<(std::ostream & out, const Dual<T, M> & rhs)
 {
     out << "(" << rhs.real << "," << rhs.epsilon << ")";
 
@@ -0,0 +1,319 @@
+#ifndef __DUAL_QUATERNION_H__
+#define __DUAL_QUATERNION_H__
+
+#include <stddef.h>
+#include <math.h>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <QuaternionBatch.h>
+#include <Dual.h>
+
+namespace IMU
+{
+
+/** @class DualQuaternion
+*
+* Rigid body transform (rotation followed by translation) as a dual
+* quaternion r + e d, where r is the rotation and d = t * r / 2.
+*
+* Composition is a product, the inverse of a unit dual quaternion is its
+* conjugate, and transforms interpolate along the screw motion (ScLERP)
+* instead of separately in rotation and translation.
+*/
+template <typename T>
+class DualQuaternion
+{
+    public:
+
+    /** Default constructor, the identity transform.
+     */
+    DualQuaternion(void) : r(), d(T(0)) {};
+
+    /**
+     * Construct from real and dual parts.
+     *
+     * @param real Real (rotation) part.
+     * @param dual Dual part.
+     */
+    DualQuaternion(const Quaternion<T> & real, const Quaternion<T> & dual) : r(real), d(dual) {};
+
+    /**
+     * Construct from rotation and translation.
+     *
+     * @param rot   Rotation, must be normalized.
+     * @param trans Translation applied after the rotation.
+     */
+    DualQuaternion(const Quaternion<T> & rot, const Vector3D<T> & trans) : r(rot), d(Quaternion<T>(trans) * rot) { d /= 2; };
+
+    /**
+     * Copy constructor.
+     */
+    DualQuaternion(const DualQuaternion<T> & rhs) : r(rhs.r), d(rhs.d) {};
+
+    // Attribute readers...
+    const Quaternion<T> & real(void) const { return r; };
+    const Quaternion<T> & dual(void) const { return d; };
+    const Quaternion<T> & rotation(void) const { return r; };
+    Vector3D<T>           translation(void) const;
+
+    // Dual quaternion operations
+    DualQuaternion<T>     conj(void)    const { return DualQuaternion<T>(r.conj(), d.conj()); };
+    DualQuaternion<T>     inverse(void) const { return conj(); };
+    Dual<T>               length(void)  const;
+    DualQuaternion<T> &   normalize(void);
+    DualQuaternion<T>     norm(void)    const { DualQuaternion<T> tmp = *this; return tmp.normalize(); };
+    DualQuaternion<T>     pow(const T & t) const;
+
+    // Methods that return or operate on a Vector3D<T>
+    Vector3D<T>           transform(const Vector3D<T> & p) const { return r.rot(p) + translation(); };
+
+    // Operators
+    DualQuaternion<T>     operator *  (const DualQuaternion<T> & rhs) const { return DualQuaternion<T>(r * rhs.r, r * rhs.d + d * rhs.r); };
+    DualQuaternion<T> &   operator *= (const DualQuaternion<T> & rhs)       { d = r * rhs.d + d * rhs.r; r *= rhs.r; return *this; };
+    DualQuaternion<T> &   operator  = (const DualQuaternion<T> & rhs)       { r = rhs.r, d = rhs.d; return *this; };
+
+    protected:
+
+    Quaternion<T> r;
+    Quaternion<T> d;
+
+}; // class DualQuaternion
+
+template <typename T>
+Vector3D<T>
+DualQuaternion<T>::translation(void) const
+{
+    Quaternion<T> t = d * r.conj();
+
+    return Vector3D<T>(2 * t.X(), 2 * t.Y(), 2 * t.Z());
+}
+
+/**
+ * Dual number norm |r| + e (r.d) / |r|.
+ *
+ * The dual part is zero for any rigid transform; it measures how far d has
+ * drifted off the tangent space of r.
+ */
+template <typename T>
+Dual<T>
+DualQuaternion<T>::length(void) const
+{
+    T len = r.length();
+
+    return Dual<T>(len, r.dot(d) / len);
+}
+
+/**
+ * Normalize (in place).
+ *
+ * Scales both parts by 1/|r| and removes the component of d along r, so the
+ * result is a unit dual quaternion and thus a rigid transform.
+ */
+template <typename T>
+DualQuaternion<T> &
+DualQuaternion<T>::normalize(void)
+{
+    T len = r.length();
+
+    if (len > T(1.0e-7))
+    {
+        Quaternion<T> rr;
+
+        r /= len;
+        d /= len;
+        rr  = r;
+        rr *= r.dot(d);
+        d  -= rr;
+    }
+    return *this;
+}
+
+/**
+ * Power of a unit dual quaternion along its screw axis.
+ *
+ * Splits the transform into angle, pitch, axis and moment, scales angle and
+ * pitch by t and reassembles it.  A pure translation is scaled directly.
+ * -(r + e d) is the same transform, so the one with r.W() >= 0 is used and
+ * the rotation angle scaled is at most pi.
+ *
+ * @param t Exponent, t = 0 is the identity and t = 1 is *this.
+ */
+template <typename T>
+DualQuaternion<T>
+DualQuaternion<T>::pow(const T & t) const
+{
+    Quaternion<T> re = r, du = d;
+
+    if (re.W() < 0)
+    {
+        re *= -1;
+        du *= -1;
+    }
+
+    const T half_theta = acos(re.W() < 1 ? re.W() : T(1));
+    const T s          = sin(half_theta);
+
+    if (fabs(s) < T(1.0e-6))
+    {
+        Quaternion<T> dd = du;
+
+        dd *= t;
+        return DualQuaternion<T>(Quaternion<T>(), dd);
+    }
+
+    const Vector3D<T> l     = re.imag() / s;
+    const T           pitch = -2 * du.W() / s;
+    const Vector3D<T> m     = (du.imag() - l * (pitch / 2 * cos(half_theta))) / s;
+
+    const T ht = half_theta * t, pt = pitch * t;
+    const T st = sin(ht), ct = cos(ht);
+    const Vector3D<T> dv = m * st + l * (pt / 2 * ct);
+
+    return DualQuaternion<T>(Quaternion<T>(ct, st * l.X(), st * l.Y(), st * l.Z()),
+                             Quaternion<T>(-pt / 2 * st, dv.X(), dv.Y(), dv.Z()));
+}
+
+/**
+ * Screw linear interpolation between two unit dual quaternions.
+ *
+ * @param a Start, returned for t = 0.
+ * @param b End, returned for t = 1.
+ * @param t Interpolation parameter.
+ *
+ * @return The transform a fraction t along the screw motion from a to b.
+ */
+template <typename T>
+inline DualQuaternion<T>
+sclerp(const DualQuaternion<T> & a, const DualQuaternion<T> & b, const T & t)
+{
+    DualQuaternion<T> diff = a.conj() * b;
+
+    // Take the short way round.
+    if (diff.real().W() < 0)
+    {
+        Quaternion<T> r = diff.real(), d = diff.dual();
+
+        r *= -1;
+        d *= -1;
+        diff = DualQuaternion<T>(r, d);
+    }
+    return a * diff.pow(t);
+}
+
+/**
+ * Transform n SoA points by dq.
+ *
+ * The points are rotated by dq's rotation matrix and translated a block at a
+ * time, so each block is read and written once while it is still in cache.
+ *
+ * @param dq The transform, must be normalized.
+ * @param x  Input X components.
+ * @param y  Input Y components.
+ * @param z  Input Z components.
+ * @param ox Output X components (may be x).
+ * @param oy Output Y components (may be y).
+ * @param oz Output Z components (may be z).
+ * @param n  Number of points.
+ */
+template <typename T>
+inline void
+transformBatch(const DualQuaternion<T> & dq, const T * x, const T * y, const T * z, T * ox, T * oy, T * oz, size_t n)
+{
+    static const size_t BLOCK = 256;
+    const Vector3D<T> t = dq.translation();
+    const T tx = t.X(), ty = t.Y(), tz = t.Z();
+    T m[9];
+
+    detail::rotMatrix(dq.rotation(), m);
+    for (size_t base = 0; base < n; base += BLOCK)
+    {
+        const size_t len = (n - base < BLOCK) ? n - base : BLOCK;
+
+        detail::rot3x3(m, x + base, y + base, z + base, ox + base, oy + base, oz + base, len);
+        for (size_t i = base; i < base + len; i++)
+        {
+            ox[i] += tx;
+            oy[i] += ty;
+            oz[i] += tz;
+        }
+    }
+}
+
+/**
+ * Transform an array of n Vector3D<T> points by dq.
+ *
+ * @param dq  The transform, must be normalized.
+ * @param in  Input points.
+ * @param out Output points (may be in).
+ * @param n   Number of points.
+ */
+template <typename T>
+inline void
+transformBatch(const DualQuaternion<T> & dq, const Vector3D<T> * in, Vector3D<T> * out, size_t n)
+{
+    static const size_t BLOCK = 128;
+    const Vector3D<T> t = dq.translation();
+    T x[BLOCK], y[BLOCK], z[BLOCK];
+    T m[9];
+
+    detail::rotMatrix(dq.rotation(), m);
+    for (size_t base = 0; base < n; base += BLOCK)
+    {
+        const size_t len = (n - base < BLOCK) ? n - base : BLOCK;
+
+        for (size_t i = 0; i < len; i++)
+        {
+            x[i] = in[base + i].X();
+            y[i] = in[base + i].Y();
+            z[i] = in[base + i].Z();
+        }
+        detail::rot3x3(m, x, y, z, x, y, z, len);
+        for (size_t i = 0; i < len; i++)
+        {
+            out[base + i].set(x[i] + t.X(), y[i] + t.Y(), z[i] + t.Z());
+        }
+    }
+}
+
+/**
+ * Compose n pairs of transforms, out[i] = a[i] * b[i].
+ *
+ * out may be a or b.
+ */
+template <typename T>
+inline void
+composeBatch(const DualQuaternion<T> * a, const DualQuaternion<T> * b, DualQuaternion<T> * out, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = a[i] * b[i];
+    }
+}
+
+/**
+ * Accumulate a kinematic chain, out[i] = links[0] * links[1] * ... * links[i].
+ *
+ * Each out[i] is the pose of link i in the frame of the chain's base.  out
+ * may be links.
+ *
+ * @param links Link transforms, each relative to the previous link.
+ * @param out   Accumulated transforms.
+ * @param n     Number of links.
+ */
+template <typename T>
+inline void
+chainBatch(const DualQuaternion<T> * links, DualQuaternion<T> * out, size_t n)
+{
+    if (n == 0) return;
+
+    out[0] = links[0];
+    for (size_t i = 1; i < n; i++)
+    {
+        out[i] = out[i - 1] * links[i];
+    }
+}
+
+}; // namespace IMU
+
+#endif //__DUAL_QUATERNION_H__
@@ -0,0 +1,201 @@
+#ifndef __DUAL_VEC_H__
+#define __DUAL_VEC_H__
+
+#include <iostream>
+#include <math.h>
+
+namespace IMU
+{
+
+/** @class DualVec
+*
+* Dual number with N infinitesimal parts.
+*
+* Where Dual<T> carries one derivative, DualVec<T, N> carries the gradient
+* with respect to N seeded inputs, so a single evaluation of a model yields
+* its full Jacobian row.  The N parts are stored contiguously and every
+* operation is a plain loop over them, which the compiler vectorizes.
+*
+* Seed input i with DualVec<T, N>::variable(value, i), evaluate, then read
+* d/dinput_i with imag(i).  DualVec<T, N> can be the T of Vector3D<T> and
+* Quaternion<T>.
+*/
+template <typename T, int N>
+class DualVec
+{
+    public:
+    // Constructors
+    DualVec(void)        : re(0)    { zero(); };
+    DualVec(T real)      : re(real) { zero(); };
+
+    /**
+     * Construct from real part and gradient.
+     *
+     * @param real Real part.
+     * @param grad Pointer to N infinitesimal parts.
+     */
+    DualVec(T real, const T * grad) __attribute__((__nonnull__)) : re(real) { for (int i = 0; i < N; i++) eps[i] = grad[i]; };
+
+    /**
+     * Construct the independent variable number i.
+     *
+     * @param real Value of the variable.
+     * @param i    Index of the variable, 0 <= i < N.
+     *
+     * @return real + 1 * e_i
+     */
+    static DualVec<T, N> variable(T real, int i) { DualVec<T, N> tmp(real); tmp.eps[i] = 1; return tmp; };
+
+    // Attribute readers...
+    T          real(void)      const { return re; };
+    T          imag(int i)     const { return eps[i]; };
+    const T  * grad(void)      const { return eps; };
+
+    // Arithmetic Operators
+    DualVec<T, N>   operator +(void) const { return *this; };
+    DualVec<T, N>   operator -(void) const { DualVec<T, N> tmp; tmp.re = -re; for (int i = 0; i < N; i++) tmp.eps[i] = -eps[i]; return tmp; };
+
+    DualVec<T, N> & operator +=(const DualVec<T, N> & rhs) { re += rhs.re; for (int i = 0; i < N; i++) eps[i] += rhs.eps[i]; return *this; };
+    DualVec<T, N> & operator -=(const DualVec<T, N> & rhs) { re -= rhs.re; for (int i = 0; i < N; i++) eps[i] -= rhs.eps[i]; return *this; };
+    DualVec<T, N> & operator *=(const DualVec<T, N> & rhs);
+    DualVec<T, N> & operator /=(const DualVec<T, N> & rhs);
+
+    DualVec<T, N> & operator +=(const T & rhs) { re += rhs; return *this; };
+    DualVec<T, N> & operator -=(const T & rhs) { re -= rhs; return *this; };
+    DualVec<T, N> & operator *=(const T & rhs) { re *= rhs; for (int i = 0; i < N; i++) eps[i] *= rhs; return *this; };
+    DualVec<T, N> & operator /=(const T & rhs) { T inv = 1 / rhs; return *this *= inv; };
+
+    friend DualVec<T, N> operator +(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { DualVec<T, N> res = lhs; res += rhs; return res; };
+    friend DualVec<T, N> operator -(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { DualVec<T, N> res = lhs; res -= rhs; return res; };
+    friend DualVec<T, N> operator *(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { DualVec<T, N> res = lhs; res *= rhs; return res; };
+    friend DualVec<T, N> operator /(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { DualVec<T, N> res = lhs; res /= rhs; return res; };
+
+    friend DualVec<T, N> operator +(const DualVec<T, N> & lhs, const T & rhs) { DualVec<T, N> res = lhs; res += rhs; return res; };
+    friend DualVec<T, N> operator -(const DualVec<T, N> & lhs, const T & rhs) { DualVec<T, N> res = lhs; res -= rhs; return res; };
+    friend DualVec<T, N> operator *(const DualVec<T, N> & lhs, const T & rhs) { DualVec<T, N> res = lhs; res *= rhs; return res; };
+    friend DualVec<T, N> operator /(const DualVec<T, N> & lhs, const T & rhs) { DualVec<T, N> res = lhs; res /= rhs; return res; };
+
+    friend DualVec<T, N> operator +(const T & lhs, const DualVec<T, N> & rhs) { DualVec<T, N> res = rhs; res += lhs; return res; };
+    friend DualVec<T, N> operator -(const T & lhs, const DualVec<T, N> & rhs) { DualVec<T, N> res = -rhs; res += lhs; return res; };
+    friend DualVec<T, N> operator *(const T & lhs, const DualVec<T, N> & rhs) { DualVec<T, N> res = rhs; res *= lhs; return res; };
+    friend DualVec<T, N> operator /(const T & lhs, const DualVec<T, N> & rhs) { T inv = 1 / rhs.re; return rhs.chain(lhs * inv, -lhs * inv * inv); };
+
+    // Comparisons look at the real part only.
+    friend bool operator ==(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { return lhs.re == rhs.re; };
+    friend bool operator !=(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { return lhs.re != rhs.re; };
+    friend bool operator < (const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { return lhs.re <  rhs.re; };
+    friend bool operator <=(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { return lhs.re <= rhs.re; };
+    friend bool operator > (const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { return lhs.re >  rhs.re; };
+    friend bool operator >=(const DualVec<T, N> & lhs, const DualVec<T, N> & rhs) { return lhs.re >= rhs.re; };
+
+    // math.h stuff, each is f(re) + f'(re) * eps
+    friend DualVec<T, N> sqrt(const DualVec<T, N> & x)  { T r = sqrt(x.re);  return x.chain(r, 1 / (2 * r)); };
+    friend DualVec<T, N> exp(const DualVec<T, N> & x)   { T r = exp(x.re);   return x.chain(r, r); };
+    friend DualVec<T, N> log(const DualVec<T, N> & x)   { return x.chain(log(x.re), 1 / x.re); };
+    friend DualVec<T, N> sin(const DualVec<T, N> & x)   { return x.chain(sin(x.re), cos(x.re)); };
+    friend DualVec<T, N> cos(const DualVec<T, N> & x)   { return x.chain(cos(x.re), -sin(x.re)); };
+    friend DualVec<T, N> tan(const DualVec<T, N> & x)   { T t = tan(x.re);   return x.chain(t, 1 + t * t); };
+    friend DualVec<T, N> asin(const DualVec<T, N> & x)  { return x.chain(asin(x.re), 1 / sqrt(1 - x.re * x.re)); };
+    friend DualVec<T, N> acos(const DualVec<T, N> & x)  { return x.chain(acos(x.re), -1 / sqrt(1 - x.re * x.re)); };
+    friend DualVec<T, N> atan(const DualVec<T, N> & x)  { return x.chain(atan(x.re), 1 / (1 + x.re * x.re)); };
+    friend DualVec<T, N> fabs(const DualVec<T, N> & x)  { return (x.re < 0) ? -x : x; };
+    // The value is pow() itself, only the derivatives use x clamped away
+    // from 0 as Dual does, so pow(0, 2) is 0 and not 0^1 * 0 or inf * 0.
+    friend DualVec<T, N> pow(const DualVec<T, N> & x, const T & y) { return x.chain(pow(x.re, y), y * pow(clamp(x.re), y - 1)); };
+    friend DualVec<T, N> atan2(const DualVec<T, N> & y, const DualVec<T, N> & x)
+    {
+        DualVec<T, N> tmp;
+        T inv = 1 / (x.re * x.re + y.re * y.re);
+
+        tmp.re = atan2(y.re, x.re);
+        for (int i = 0; i < N; i++)
+        {
+            tmp.eps[i] = (x.re * y.eps[i] - y.re * x.eps[i]) * inv;
+        }
+
+        return tmp;
+    };
+    friend DualVec<T, N> pow(const DualVec<T, N> & x, const DualVec<T, N> & y)
+    {
+        DualVec<T, N> tmp;
+        const T c = clamp(x.re), r = pow(c, y.re - 1);
+        const T dx = y.re * r, dy = r * c * log(c);
+
+        tmp.re = pow(x.re, y.re);
+        for (int i = 0; i < N; i++)
+        {
+            tmp.eps[i] = dx * x.eps[i] + ((y.eps[i] != 0) ? dy * y.eps[i] : T(0));
+        }
+
+        return tmp;
+    };
+
+    template <class D, int M> friend std::ostream & operator <<(std::ostream & out, const DualVec<D, M> & rhs);
+
+    private:
+
+    /** f(x) given f(re) and f'(re).
+     */
+    DualVec<T, N> chain(const T & f, const T & df) const { DualVec<T, N> tmp; tmp.re = f; for (int i = 0; i < N; i++) tmp.eps[i] = df * eps[i]; return tmp; };
+
+    void zero(void) { for (int i = 0; i < N; i++) eps[i] = 0; };
+
+    /** |x| kept above 1e-15 for the pow() derivatives, as Dual does. */
+    static T clamp(const T & x)
+    {
+        static const T min_real = 1e-15;
+
+        if (fabs(x) >= min_real) return x;
+        return (x >= 0) ? min_real : -min_real;
+    }
+
+    // The real and infinitesimal parts.
+    T re;
+    T eps[N];
+
+}; // Class DualVec
+
+template <typename T, int N>
+DualVec<T, N> &
+DualVec<T, N>::operator *=(const DualVec<T, N> & rhs)
+{
+    for (int i = 0; i < N; i++)
+    {
+        eps[i] = re * rhs.eps[i] + eps[i] * rhs.re;
+    }
+    re *= rhs.re;
+
+    return *this;
+}
+
+template <typename T, int N>
+DualVec<T, N> &
+DualVec<T, N>::operator /=(const DualVec<T, N> & rhs)
+{
+    T inv = 1 / rhs.re;
+
+    re *= inv;
+    for (int i = 0; i < N; i++)
+    {
+        eps[i] = (eps[i] - re * rhs.eps[i]) * inv;
+    }
+
+    return *this;
+}
+
+template <typename T, int N>
+std::ostream & operator <<(std::ostream & out, const DualVec<T, N> & rhs)
+{
+    out << "(" << rhs.re;
+    for (int i = 0; i < N; i++)
+    {
+        out << "," << rhs.eps[i];
+    }
+    out << ")";
+
+    return out;
+}
+
+}; // Namespace IMU
+
+#endif //__DUAL_VEC_H__
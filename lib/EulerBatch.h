@@ -0,0 +1,409 @@
+#ifndef __EULER_BATCH_H__
+#define __EULER_BATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <float.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <MathPolicy.h>
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <QuaternionBatch.h>
+
+namespace IMU
+{
+
+/**
+ * Batch Quaternion to Euler angle conversion.
+ *
+ * Angles are always returned per axis, the angle about X in x (or ax[]), Y
+ * in y, Z in z; the sequence only says in which order they compose.  For
+ * EULER_ZYX the rotation is Rz(z) * Ry(y) * Rx(x) (yaw, then pitch, then
+ * roll, intrinsic).  EULER_LEGACY is what Quaternion<T>::getEulerAngles()
+ * returns: ZYX of the conjugate quaternion.
+ *
+ * The middle angle comes from an asin and is in [-pi/2, pi/2], the other two
+ * from atan2.  The asin argument is clamped to [-1, 1], so drift past +-1 no
+ * longer yields NaN.  Within 1e-6 of +-1 (middle angle within ~0.08 degrees
+ * of +-90) the sample is gimbal locked: the first and last angles are no
+ * longer separable, so the last is set to 0 and the first absorbs the whole
+ * rotation about the remaining axis.  The angles of a locked sample still
+ * reproduce its attitude to within 2.9e-3 rad (2 sqrt(2e-6) at the threshold,
+ * plus rounding).  Locked samples are counted and may be flagged individually.
+ *
+ * Inputs need not be exactly unit length, the asin argument is divided by
+ * |q|^2.
+ *
+ * EULER_EXACT uses the math.h functions.  EULER_APPROX uses polynomials, 4
+ * samples at a time with SSE2 for float.  They add at most 2.5e-7 rad to the
+ * exact result; for float the total stays within 1.2e-6 rad of the exact
+ * float result while the middle angle is below 84 degrees.  Closer to +-90
+ * both modes are dominated by rounding of the asin argument, amplified by
+ * 1 / cos(middle angle).
+ */
+enum EulerSequence
+{
+    EULER_XYZ,
+    EULER_XZY,
+    EULER_YXZ,
+    EULER_YZX,
+    EULER_ZXY,
+    EULER_ZYX,
+    EULER_LEGACY
+};
+
+enum EulerMode
+{
+    EULER_EXACT,
+    EULER_APPROX
+};
+
+namespace detail
+{
+
+/**
+ * Rotation matrix element indices for one sequence.
+ *
+ * For R = Ri(a) * Rj(b) * Rk(c), e = +1 for cyclic (i, j, k), -1 otherwise:
+ *   b = asin(e * R[i][k])
+ *   a = atan2(-e * R[j][k], R[k][k]),  c = atan2(-e * R[i][j], R[i][i])
+ * and at gimbal lock, with c = 0:
+ *   a = atan2(e * R[k][j], R[j][j])
+ */
+struct EulerIndex
+{
+    int i, j, k;
+    int e;
+    int ik, jk, kk, ij, ii, kj, jj;
+
+    explicit EulerIndex(EulerSequence seq)
+    {
+        static const int axes[7][4] = {
+            { 0, 1, 2,  1 }, { 0, 2, 1, -1 }, { 1, 0, 2, -1 }, { 1, 2, 0,  1 },
+            { 2, 0, 1,  1 }, { 2, 1, 0, -1 }, { 2, 1, 0, -1 }
+        };
+        const bool t = (seq == EULER_LEGACY);   // conjugate: use the transpose
+
+        i = axes[seq][0], j = axes[seq][1], k = axes[seq][2], e = axes[seq][3];
+        ik = at(i, k, t), jk = at(j, k, t), kk = at(k, k, t);
+        ij = at(i, j, t), ii = at(i, i, t), kj = at(k, j, t), jj = at(j, j, t);
+    }
+
+    static int at(int r, int c, bool t) { return t ? c * 3 + r : r * 3 + c; };
+};
+
+static const double EULER_GIMBAL = 1 - 1e-6;
+
+/** math.h asin and atan2 through the default policy.
+ */
+struct EulerExact
+{
+    template <typename T> static T asin (const T & x)             { return PreciseMath::asin(x); };
+    template <typename T> static T atan2(const T & y, const T & x){ return PreciseMath::atan2(y, x); };
+};
+
+/**
+ * Polynomial asin and atan2.
+ *
+ * asin: Abramowitz & Stegun 4.4.46, pi/2 - sqrt(1 - x) * P7(x), 2e-8.
+ * atan: t * P6(t^2) on [0, 1] (minimax, 2.5e-7), folded by octant.
+ */
+struct EulerApprox
+{
+    template <typename T>
+    static T asin(const T & x)
+    {
+        const T a = (x < 0) ? -x : x;
+        T p = T(-0.0012624911);
+
+        p = p * a + T( 0.0066700901);
+        p = p * a + T(-0.0170881256);
+        p = p * a + T( 0.0308918810);
+        p = p * a + T(-0.0501743046);
+        p = p * a + T( 0.0889789874);
+        p = p * a + T(-0.2145988016);
+        p = p * a + T( 1.5707963050);
+        p = T(1.57079632679489662) - PreciseMath::sqrt(1 - a) * p;
+
+        return (x < 0) ? -p : p;
+    };
+
+    template <typename T>
+    static T atan2(const T & y, const T & x)
+    {
+        const T ax = (x < 0) ? -x : x, ay = (y < 0) ? -y : y;
+        const T mx = (ax > ay) ? ax : ay, mn = (ax > ay) ? ay : ax;
+        const T t = (mx > 0) ? mn / mx : T(0), s = t * t;
+        T p = T(0.00681143697);
+
+        p = p * s + T(-0.033603075);
+        p = p * s + T( 0.0796222591);
+        p = p * s + T(-0.132332587);
+        p = p * s + T( 0.198077917);
+        p = p * s + T(-0.333173652);
+        p = p * s + T( 0.999996111);
+        p = p * t;
+
+        if (ay > ax) p = T(1.57079632679489662) - p;
+        if (x < 0)   p = T(3.14159265358979324) - p;
+        return (y < 0) ? -p : p;
+    };
+};
+
+/**
+ * Euler angles of one quaternion.
+ *
+ * @return true if gimbal locked.
+ */
+template <class F, typename T>
+inline bool
+euler(const EulerIndex & ix, T w, T x, T y, T z, T * out)
+{
+    const Quaternion<T> q(w, x, y, z);
+    T m[9], s;
+    bool locked;
+
+    rotMatrix(q, m);
+    s = ix.e * m[ix.ik] / (w * w + x * x + y * y + z * z);
+    if (s >  1) s =  1;
+    if (s < -1) s = -1;
+    locked = (s > T(EULER_GIMBAL) || s < -T(EULER_GIMBAL));
+
+    out[ix.j] = F::asin(s);
+    if (!locked)
+    {
+        out[ix.i] = F::atan2(-ix.e * m[ix.jk], m[ix.kk]);
+        out[ix.k] = F::atan2(-ix.e * m[ix.ij], m[ix.ii]);
+    }
+    else
+    {
+        out[ix.i] = F::atan2(ix.e * m[ix.kj], m[ix.jj]);
+        out[ix.k] = 0;
+    }
+    return locked;
+}
+
+template <class F, typename T>
+inline size_t
+eulerLoop(const EulerIndex & ix, const T * w, const T * x, const T * y, const T * z,
+          T * ax, T * ay, T * az, uint8_t * locked, size_t n)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        T a[3];
+        const bool l = euler<F>(ix, w[i], x[i], y[i], z[i], a);
+
+        ax[i] = a[0], ay[i] = a[1], az[i] = a[2];
+        if (locked) locked[i] = l;
+        count += l;
+    }
+    return count;
+}
+
+template <class F, typename T>
+inline size_t
+eulerSoA(const EulerIndex & ix, const T * w, const T * x, const T * y, const T * z,
+         T * ax, T * ay, T * az, uint8_t * locked, size_t n)
+{
+    return eulerLoop<F>(ix, w, x, y, z, ax, ay, az, locked, n);
+}
+
+#if defined(__SSE2__)
+
+inline __m128 select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+
+inline __m128
+asinps(__m128 x)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 a = _mm_andnot_ps(sign, x);
+    __m128 p = _mm_set1_ps(-0.0012624911f);
+
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps( 0.0066700901f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.0170881256f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps( 0.0308918810f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.0501743046f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps( 0.0889789874f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.2145988016f));
+    p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps( 1.5707963050f));
+    p = _mm_sub_ps(_mm_set1_ps(1.57079632679f), _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), p));
+
+    return _mm_or_ps(p, _mm_and_ps(sign, x));
+}
+
+inline __m128
+atan2ps(__m128 y, __m128 x)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 ax = _mm_andnot_ps(sign, x), ay = _mm_andnot_ps(sign, y);
+    const __m128 mx = _mm_max_ps(ax, ay), mn = _mm_min_ps(ax, ay);
+    const __m128 t = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(FLT_MIN)));
+    const __m128 s = _mm_mul_ps(t, t);
+    __m128 p = _mm_set1_ps(0.00681143697f);
+
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.033603075f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.0796222591f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.132332587f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.198077917f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.333173652f));
+    p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps( 0.999996111f));
+    p = _mm_mul_ps(p, t);
+
+    p = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(1.57079632679f), p), p);
+    p = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.14159265359f), p), p);
+
+    return _mm_xor_ps(p, _mm_and_ps(sign, y));
+}
+
+/**
+ * EULER_APPROX for float, 4 samples per iteration, scalar tail.
+ */
+template <>
+inline size_t
+eulerSoA<EulerApprox, float>(const EulerIndex & ix, const float * w, const float * x, const float * y, const float * z,
+                             float * ax, float * ay, float * az, uint8_t * locked, size_t n)
+{
+    float * out[3] = { ax, ay, az };
+    const __m128 e = _mm_set1_ps((float)ix.e), ne = _mm_set1_ps((float)-ix.e);
+    const __m128 one = _mm_set1_ps(1.0f), lim = _mm_set1_ps((float)EULER_GIMBAL);
+    size_t count = 0, i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 qw = _mm_loadu_ps(w + i), qx = _mm_loadu_ps(x + i), qy = _mm_loadu_ps(y + i), qz = _mm_loadu_ps(z + i);
+        const __m128 ww = _mm_mul_ps(qw, qw), xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        const __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        const __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+        const __m128 two = _mm_set1_ps(2.0f);
+        __m128 m[9], s, lock, a, c, b;
+        int bits;
+
+        m[0] = _mm_sub_ps(_mm_add_ps(ww, xx), _mm_add_ps(yy, zz));
+        m[1] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+        m[2] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+        m[3] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+        m[4] = _mm_sub_ps(_mm_add_ps(ww, yy), _mm_add_ps(xx, zz));
+        m[5] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+        m[6] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+        m[7] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+        m[8] = _mm_sub_ps(_mm_add_ps(ww, zz), _mm_add_ps(xx, yy));
+
+        s = _mm_div_ps(_mm_mul_ps(e, m[ix.ik]), _mm_add_ps(_mm_add_ps(ww, xx), _mm_add_ps(yy, zz)));
+        s = _mm_max_ps(_mm_min_ps(s, one), _mm_sub_ps(_mm_setzero_ps(), one));
+        lock = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), s), lim);
+        bits = _mm_movemask_ps(lock);
+
+        b = asinps(s);
+        a = atan2ps(_mm_mul_ps(ne, m[ix.jk]), m[ix.kk]);
+        c = atan2ps(_mm_mul_ps(ne, m[ix.ij]), m[ix.ii]);
+        if (bits)
+        {
+            a = select(lock, atan2ps(_mm_mul_ps(e, m[ix.kj]), m[ix.jj]), a);
+            c = _mm_andnot_ps(lock, c);
+            count += ((bits >> 0) & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+        }
+
+        _mm_storeu_ps(out[ix.i] + i, a);
+        _mm_storeu_ps(out[ix.j] + i, b);
+        _mm_storeu_ps(out[ix.k] + i, c);
+        if (locked)
+        {
+            locked[i + 0] = (bits >> 0) & 1, locked[i + 1] = (bits >> 1) & 1;
+            locked[i + 2] = (bits >> 2) & 1, locked[i + 3] = (bits >> 3) & 1;
+        }
+    }
+
+    return count + eulerLoop<EulerApprox>(ix, w + i, x + i, y + i, z + i, ax + i, ay + i, az + i, locked ? locked + i : 0, n - i);
+}
+
+#endif // __SSE2__
+
+}; // namespace detail
+
+/**
+ * Euler angles of a single quaternion.
+ *
+ * @param q      The attitude.
+ * @param seq    Rotation sequence.
+ * @param locked If not NULL, set to whether q is gimbal locked.
+ *
+ * @return Angles about X, Y and Z.
+ */
+template <typename T>
+inline Vector3D<T>
+eulerAngles(const Quaternion<T> & q, EulerSequence seq, bool * locked = NULL)
+{
+    const detail::EulerIndex ix(seq);
+    T a[3];
+    const bool l = detail::euler<detail::EulerExact>(ix, q.W(), q.X(), q.Y(), q.Z(), a);
+
+    if (locked) *locked = l;
+    return Vector3D<T>(a[0], a[1], a[2]);
+}
+
+/**
+ * Convert n SoA quaternions to Euler angles.
+ *
+ * @param w, x, y, z Quaternion components.
+ * @param ax, ay, az Output angles about X, Y and Z (radians).
+ * @param n          Number of quaternions.
+ * @param seq        Rotation sequence.
+ * @param mode       EULER_EXACT or EULER_APPROX.
+ * @param locked     Optional, n flags set to 1 for gimbal locked samples.
+ *
+ * @return Number of gimbal locked samples.
+ */
+template <typename T>
+inline size_t
+eulerBatch(const T * w, const T * x, const T * y, const T * z, T * ax, T * ay, T * az, size_t n,
+           EulerSequence seq = EULER_LEGACY, EulerMode mode = EULER_EXACT, uint8_t * locked = NULL)
+{
+    const detail::EulerIndex ix(seq);
+
+    if (mode == EULER_APPROX) return detail::eulerSoA<detail::EulerApprox>(ix, w, x, y, z, ax, ay, az, locked, n);
+    return detail::eulerSoA<detail::EulerExact>(ix, w, x, y, z, ax, ay, az, locked, n);
+}
+
+/**
+ * Convert an array of n Quaternion<T> to Euler angles.
+ *
+ * @param q      Input quaternions.
+ * @param out    Output angles about X, Y and Z (radians).
+ *
+ * Other parameters and return value as for the SoA version.
+ */
+template <typename T>
+inline size_t
+eulerBatch(const Quaternion<T> * q, Vector3D<T> * out, size_t n,
+           EulerSequence seq = EULER_LEGACY, EulerMode mode = EULER_EXACT, uint8_t * locked = NULL)
+{
+    static const size_t BLOCK = 128;
+    T w[BLOCK], x[BLOCK], y[BLOCK], z[BLOCK];
+    size_t count = 0;
+
+    for (size_t base = 0; base < n; base += BLOCK)
+    {
+        const size_t len = (n - base < BLOCK) ? n - base : BLOCK;
+
+        for (size_t i = 0; i < len; i++)
+        {
+            w[i] = q[base + i].W(), x[i] = q[base + i].X(), y[i] = q[base + i].Y(), z[i] = q[base + i].Z();
+        }
+        count += eulerBatch(w, x, y, z, x, y, z, len, seq, mode, locked ? locked + base : NULL);
+        for (size_t i = 0; i < len; i++)
+        {
+            out[base + i].set(x[i], y[i], z[i]);
+        }
+    }
+    return count;
+}
+
+}; // namespace IMU
+
+#endif //__EULER_BATCH_H__
@@ -0,0 +1,72 @@
+#ifndef __FAST_MATH_H__
+#define __FAST_MATH_H__
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace IMU
+{
+
+/**
+ * Fast reciprocal square root, 1 / sqrt(x), for x > 0.
+ *
+ * Normalizing by multiplying with rsqrt() replaces a sqrt and a division per
+ * component with one estimate and a few multiplies.
+ *
+ * float:  with SSE, rsqrtss plus one Newton step, max relative error 2.9e-7.
+ *         Otherwise the 0x5f375a86 bit trick plus two Newton steps, max
+ *         relative error 4.8e-6.
+ * double: the float estimate plus two Newton steps in double, max relative
+ *         error 4.1e-16.  x must be within float range.
+ *
+ * Fixed<F> has its own integer rsqrt(), any other T falls back to
+ * 1 / sqrt(x).
+ */
+inline float
+rsqrt(float x)
+{
+#if defined(__SSE__)
+    float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+
+    return y * (1.5f - 0.5f * x * y * y);
+#else
+    uint32_t i;
+    float y;
+
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86 - (i >> 1);
+    memcpy(&y, &i, sizeof(y));
+
+    y = y * (1.5f - 0.5f * x * y * y);
+    y = y * (1.5f - 0.5f * x * y * y);
+
+    return y;
+#endif
+}
+
+inline double
+rsqrt(double x)
+{
+    double y = rsqrt((float)x);
+
+    y = y * (1.5 - 0.5 * x * y * y);
+    y = y * (1.5 - 0.5 * x * y * y);
+
+    return y;
+}
+
+template <typename T>
+inline T
+rsqrt(const T & x)
+{
+    return 1 / sqrt(x);
+}
+
+}; // namespace IMU
+
+#endif //__FAST_MATH_H__
@@ -0,0 +1,251 @@
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include <stdint.h>
+
+namespace IMU
+{
+
+/** @class Fixed
+*
+* Signed 32 bit fixed point scalar with F fractional bits (Q(31-F).F).
+*
+* Meant as the T of Vector3D<T>, Quaternion<T> and Dual<T> on targets without
+* an FPU.  All arithmetic is integer only and saturates at the ends of the
+* representable range instead of wrapping.  The math functions the other
+* classes look up unqualified (sqrt, rsqrt, fabs, atan2, asin) are friends,
+* so they are only found for Fixed arguments and never hide the math.h ones.
+*
+* Use Q1_30 for unit quaternions and direction vectors (range [-2, 2),
+* resolution 9.3e-10) and Q16_16 for anything else, including angles
+* (range [-32768, 32768), resolution 1.5e-5).  atan2() in Q1_30 saturates
+* beyond +/-2 rad.
+*
+* The float/double constructors are for constants and I/O; on an FPU-less
+* target they go through soft-float, so keep them out of the hot path.
+*/
+template <int F>
+class Fixed
+{
+    public:
+
+    /** Number of fractional bits.
+     */
+    static const int FRAC = F;
+
+    /** Default constructor, zero.
+     */
+    Fixed(void) : v(0) {};
+
+    /**
+     * Construct from integer value.
+     *
+     * @param i Integer value, saturated to the representable range.
+     */
+    Fixed(int i) : v(sat((int64_t)i * ((int64_t)1 << F))) {};
+
+    /**
+     * Construct from floating point value (rounded to nearest).
+     *
+     * @param f Value, saturated to the representable range.
+     */
+    Fixed(float f)  : v(fromReal((double)f)) {};
+    Fixed(double f) : v(fromReal(f)) {};
+
+    /**
+     * Construct from raw Q(31-F).F representation.
+     *
+     * @param r Raw value.
+     *
+     * @return The Fixed with raw value r.
+     */
+    static Fixed fromRaw(int32_t r) { Fixed tmp; tmp.v = r; return tmp; };
+
+    /** Largest and smallest representable values.
+     */
+    static Fixed max(void) { return fromRaw(INT32_MAX); };
+    static Fixed min(void) { return fromRaw(INT32_MIN); };
+
+    // Attribute readers...
+    int32_t      raw(void)      const { return v; };
+    float        toFloat(void)  const { return (float)v / (float)((int64_t)1 << F); };
+    double       toDouble(void) const { return (double)v / (double)((int64_t)1 << F); };
+
+    // Operators
+    Fixed   operator -  (void) const { return fromRaw(sat(-(int64_t)v)); };
+    Fixed   operator +  (void) const { return *this; };
+
+    Fixed & operator += (const Fixed & rhs) { v = sat((int64_t)v + rhs.v); return *this; };
+    Fixed & operator -= (const Fixed & rhs) { v = sat((int64_t)v - rhs.v); return *this; };
+    Fixed & operator *= (const Fixed & rhs) { v = mul(v, rhs.v); return *this; };
+    Fixed & operator /= (const Fixed & rhs) { v = div(v, rhs.v); return *this; };
+
+    friend Fixed operator + (const Fixed & lhs, const Fixed & rhs) { Fixed res = lhs; res += rhs; return res; };
+    friend Fixed operator - (const Fixed & lhs, const Fixed & rhs) { Fixed res = lhs; res -= rhs; return res; };
+    friend Fixed operator * (const Fixed & lhs, const Fixed & rhs) { return fromRaw(mul(lhs.v, rhs.v)); };
+    friend Fixed operator / (const Fixed & lhs, const Fixed & rhs) { return fromRaw(div(lhs.v, rhs.v)); };
+
+    friend bool  operator == (const Fixed & lhs, const Fixed & rhs) { return lhs.v == rhs.v; };
+    friend bool  operator != (const Fixed & lhs, const Fixed & rhs) { return lhs.v != rhs.v; };
+    friend bool  operator <  (const Fixed & lhs, const Fixed & rhs) { return lhs.v <  rhs.v; };
+    friend bool  operator <= (const Fixed & lhs, const Fixed & rhs) { return lhs.v <= rhs.v; };
+    friend bool  operator >  (const Fixed & lhs, const Fixed & rhs) { return lhs.v >  rhs.v; };
+    friend bool  operator >= (const Fixed & lhs, const Fixed & rhs) { return lhs.v >= rhs.v; };
+
+    // math.h stuff
+    friend Fixed fabs(const Fixed & x) { return (x.v < 0) ? -x : x; };
+    friend Fixed sqrt(const Fixed & x) { return fromRaw(isqrt(x.v)); };
+    friend Fixed rsqrt(const Fixed & x) { return fromRaw(irsqrt(x.v)); };
+    friend Fixed atan2(const Fixed & y, const Fixed & x) { return fromRaw(iatan2(y.v, x.v)); };
+    friend Fixed asin(const Fixed & x)
+    {
+        const Fixed one(1);
+        Fixed c = x;
+
+        if (c >  one) c =  one;
+        if (c < -one) c = -one;
+
+        return atan2(c, sqrt(one - c * c));
+    };
+
+    private:
+
+    int32_t v;
+
+    static int32_t sat(int64_t r)
+    {
+        if (r > INT32_MAX) return INT32_MAX;
+        if (r < INT32_MIN) return INT32_MIN;
+        return (int32_t)r;
+    }
+
+    static int32_t fromReal(double f)
+    {
+        double r = f * (double)((int64_t)1 << F);
+
+        if (r >= (double)INT32_MAX) return INT32_MAX;
+        if (r <= (double)INT32_MIN) return INT32_MIN;
+        return (int32_t)((r < 0) ? r - 0.5 : r + 0.5);
+    }
+
+    static int32_t mul(int32_t a, int32_t b)
+    {
+        return sat(((int64_t)a * b + ((int64_t)1 << (F - 1))) >> F);
+    }
+
+    static int32_t div(int32_t a, int32_t b)
+    {
+        if (b == 0) return (a < 0) ? INT32_MIN : INT32_MAX;
+        return sat(((int64_t)a * ((int64_t)1 << F)) / b);
+    }
+
+    /** Square root of the raw value, bit by bit on the 64 bit widened operand.
+     */
+    static int32_t isqrt(int32_t a)
+    {
+        uint64_t op  = (a > 0) ? (uint64_t)a << F : 0;
+        uint64_t res = 0;
+        uint64_t one = (uint64_t)1 << 62;
+
+        while (one > op) one >>= 2;
+        while (one != 0)
+        {
+            if (op >= res + one)
+            {
+                op  -= res + one;
+                res  = (res >> 1) + one;
+            }
+            else
+            {
+                res >>= 1;
+            }
+            one >>= 2;
+        }
+        return sat((int64_t)res);
+    }
+
+    /**
+     * Reciprocal square root of the raw value.
+     *
+     * The operand is scaled by 4^-k into m in [0.25, 1), 1/sqrt(m) is seeded
+     * from a 12 entry table (max 5.5% off) and refined by three Newton steps
+     * in Q2.30, then scaled back by 2^-k.  Non-positive input saturates to
+     * max().
+     */
+    static int32_t irsqrt(int32_t a)
+    {
+        // 1/sqrt(m) over each 1/16 slice of [0.25, 1), equal relative error at both ends, Q2.30
+        static const uint32_t seed[12] =
+        {
+            0x78dde6e6, 0x6d459e1c, 0x647c6572, 0x5d87af2b, 0x57d86660, 0x53160eb7,
+            0x4f069649, 0x4b821517, 0x486c1702, 0x45afb342, 0x433d27fa, 0x410853ac,
+        };
+        int bits = 0, k, s, sh;
+        uint64_t m, y;
+
+        if (a <= 0) return INT32_MAX;
+
+        while (((uint32_t)a >> bits) != 0) bits++;
+        k = (bits - F + ((bits - F > 0) ? 1 : 0)) / 2;
+
+        s = 30 - F - 2 * k;
+        m = (s >= 0) ? (uint64_t)a << s : (uint64_t)a >> -s;
+
+        y = seed[(m >> 26) - 4];
+        for (int i = 0; i < 3; i++)
+        {
+            uint64_t t = (((y * y) >> 30) * m) >> 30;
+            y = (y * ((3ULL << 30) - t)) >> 31;
+        }
+
+        sh = F - 30 - k;
+        if (sh >= 0)
+        {
+            if (sh >= 32 || (y >> (62 - sh)) != 0) return INT32_MAX;
+            return sat((int64_t)(y << sh));
+        }
+        return sat((int64_t)((-sh >= 64) ? 0 : (y >> -sh)));
+    }
+
+    /**
+     * Four quadrant arctangent of the raw values.
+     *
+     * atan() on [0, 1] is a degree 9 odd minimax polynomial (max error
+     * 1.1e-5 rad) evaluated in Q2.30 whatever F is; the other octants are
+     * folded onto it.
+     */
+    static int32_t iatan2(int32_t y, int32_t x)
+    {
+        static const int64_t HALF_PI = 1686629713LL, PI = 3373259426LL;
+        static const int64_t C1 = 1073597943LL, C3 = -354656388LL, C5 = 193424926LL, C7 = -91410863LL, C9 = 22371518LL;
+        const int64_t ax = (x < 0) ? -(int64_t)x : x;
+        const int64_t ay = (y < 0) ? -(int64_t)y : y;
+        const bool swap = ay > ax;
+        int64_t z, z2, r;
+
+        if (ax == 0 && ay == 0) return 0;
+
+        z  = swap ? (ax << 30) / ay : (ay << 30) / ax;
+        z2 = (z * z) >> 30;
+        r  = C7 + ((z2 * C9) >> 30);
+        r  = C5 + ((z2 * r)  >> 30);
+        r  = C3 + ((z2 * r)  >> 30);
+        r  = C1 + ((z2 * r)  >> 30);
+        r  = (z * r) >> 30;
+
+        if (swap)  r = HALF_PI - r;
+        if (x < 0) r = PI - r;
+        if (y < 0) r = -r;
+
+        return sat((F < 30) ? (r + ((int64_t)1 << (29 - F))) >> (30 - F) : r);
+    }
+}; // class Fixed
+
+/** The two formats the library is tuned for.
+ */
+typedef Fixed<30> Q1_30;
+typedef Fixed<16> Q16_16;
+
+}; // namespace IMU
+
+#endif //__FIXED_H__
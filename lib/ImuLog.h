@@ -0,0 +1,618 @@
+#ifndef __IMU_LOG_H__
+#define __IMU_LOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <ImuSample.h>
+
+namespace IMU
+{
+
+/**
+ * Columnar binary log of IMU samples and attitudes.
+ *
+ * Layout, all offsets from the start of the file and 64 byte aligned:
+ *
+ *   LogHeader                 64 bytes
+ *   chunk 0 .. chunk n-1      LogChunkHeader, then the columns of the chunk
+ *   chunk index               n LogIndexEntry, located by LogHeader::indexOffset
+ *
+ * A chunk holds up to chunkRows rows as structure-of-arrays columns, each
+ * padded to 64 bytes: the uint64_t timestamps, then x, y, z of every vector
+ * channel present (gyro, accel, mag in that order) and w, x, y, z of the
+ * attitude.  Scalars are float or double as recorded in the header, in host
+ * byte order; a reader on a host of the other byte order refuses the file.
+ *
+ * The header and index are written last.  A log whose writer died before
+ * close() has indexOffset 0; the reader then rebuilds the index by walking
+ * the chunk headers and keeps every complete chunk.  It does the same when
+ * an index entry does not point at a chunk that fits in the file.
+ */
+enum ImuLogChannel
+{
+    LOG_GYRO     = 1,
+    LOG_ACCEL    = 2,
+    LOG_MAG      = 4,
+    LOG_ATTITUDE = 8
+};
+
+static const uint32_t IMU_LOG_VERSION = 1;
+
+namespace detail
+{
+
+static const char     LOG_MAGIC[8]   = { 'I', 'M', 'U', 'L', 'O', 'G', '\0', '\0' };
+static const uint32_t LOG_CHUNK_MAGIC = 0x4b4e4843;  // "CHNK"
+static const uint32_t LOG_BYTE_ORDER  = 0x01020304;
+
+struct LogHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t scalarSize;
+    uint32_t channels;
+    uint32_t chunkRows;
+    uint32_t reserved;
+    uint64_t rows;
+    uint64_t chunks;
+    uint64_t indexOffset;
+    uint64_t pad;
+};
+
+struct LogChunkHeader
+{
+    uint32_t magic;
+    uint32_t rows;
+    uint64_t firstRow;
+    uint64_t firstStamp;
+    uint64_t lastStamp;
+    uint64_t bytes;         // whole chunk including this header
+    uint64_t pad[3];
+};
+
+struct LogIndexEntry
+{
+    uint64_t offset;
+    uint64_t firstRow;
+    uint64_t firstStamp;
+    uint64_t lastStamp;
+    uint32_t rows;
+    uint32_t reserved;
+};
+
+inline size_t align64(size_t n) { return (n + 63) & ~(size_t)63; };
+
+/** Number of scalar columns for a channel mask.
+ */
+inline int logColumns(uint32_t channels)
+{
+    return ((channels & LOG_GYRO) ? 3 : 0) + ((channels & LOG_ACCEL) ? 3 : 0) +
+           ((channels & LOG_MAG) ? 3 : 0) + ((channels & LOG_ATTITUDE) ? 4 : 0);
+}
+
+/** Index of the first scalar column of a channel, -1 if absent.
+ */
+inline int logColumn(uint32_t channels, ImuLogChannel ch)
+{
+    int col = 0;
+
+    for (uint32_t bit = LOG_GYRO; bit <= LOG_ATTITUDE; bit <<= 1)
+    {
+        if (bit == (uint32_t)ch) return (channels & bit) ? col : -1;
+        if (channels & bit) col += (bit == LOG_ATTITUDE) ? 4 : 3;
+    }
+    return -1;
+}
+
+/** Bytes of one chunk with the given row capacity.
+ */
+inline size_t logChunkBytes(uint32_t channels, size_t scalarSize, size_t rows)
+{
+    return sizeof(LogChunkHeader) + align64(rows * sizeof(uint64_t)) + logColumns(channels) * align64(rows * scalarSize);
+}
+
+}; // namespace detail
+
+/** @class Vector3DSpan
+*
+* Zero-copy view of n vectors stored as x[], y[], z[] columns.  The column
+* pointers go straight into the SoA batch kernels (rotBatch, ...).
+*/
+template <typename T>
+struct Vector3DSpan
+{
+    Vector3DSpan(void) : x(NULL), y(NULL), z(NULL), n(0) {};
+    Vector3DSpan(const T * x, const T * y, const T * z, size_t n) : x(x), y(y), z(z), n(n) {};
+
+    size_t      size(void)            const { return n; };
+    Vector3D<T> operator [] (size_t i) const { return Vector3D<T>(x[i], y[i], z[i]); };
+
+    const T * x;
+    const T * y;
+    const T * z;
+    size_t    n;
+}; // struct Vector3DSpan
+
+/** @class QuaternionSpan
+*
+* Zero-copy view of n quaternions stored as w[], x[], y[], z[] columns
+* (eulerBatch, ...).
+*/
+template <typename T>
+struct QuaternionSpan
+{
+    QuaternionSpan(void) : w(NULL), x(NULL), y(NULL), z(NULL), n(0) {};
+    QuaternionSpan(const T * w, const T * x, const T * y, const T * z, size_t n) : w(w), x(x), y(y), z(z), n(n) {};
+
+    size_t        size(void)            const { return n; };
+    Quaternion<T> operator [] (size_t i) const { return Quaternion<T>(w[i], x[i], y[i], z[i]); };
+
+    const T * w;
+    const T * x;
+    const T * y;
+    const T * z;
+    size_t    n;
+}; // struct QuaternionSpan
+
+/** @class ImuLogWriter
+*
+* Appends rows to a new log, one chunk buffered in memory.
+*
+* Every row has a timestamp and a value for each channel given to open();
+* channels a row does not carry are written as zero.  All methods return
+* false on I/O errors, after which the writer is closed.
+*/
+template <typename T>
+class ImuLogWriter
+{
+    public:
+
+    ImuLogWriter(void) : f(NULL), stamps(NULL), buf(NULL), stride(0), cols(0), fill(0) { memset(&hdr, 0, sizeof(hdr)); };
+    ~ImuLogWriter(void) { close(); };
+
+    ImuLogWriter(const ImuLogWriter<T> &) = delete;
+    ImuLogWriter<T> & operator = (const ImuLogWriter<T> &) = delete;
+
+    /**
+     * Create (or truncate) a log.
+     *
+     * @param path      File name.
+     * @param channels  Mask of ImuLogChannel values.
+     * @param chunkRows Rows per chunk.
+     */
+    bool open(const char * path, uint32_t channels, uint32_t chunkRows = 4096)
+    {
+        close();
+        if (!chunkRows || !channels) return false;
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, detail::LOG_MAGIC, sizeof(hdr.magic));
+        hdr.version    = IMU_LOG_VERSION;
+        hdr.byteOrder  = detail::LOG_BYTE_ORDER;
+        hdr.scalarSize = sizeof(T);
+        hdr.channels   = channels;
+        hdr.chunkRows  = chunkRows;
+
+        stride = detail::align64(chunkRows * sizeof(T)) / sizeof(T);
+        cols   = detail::logColumns(channels);
+        stamps = (uint64_t *)malloc(chunkRows * sizeof(uint64_t));
+        buf    = (T *)malloc(cols * stride * sizeof(T));
+        fill   = 0;
+        if (!stamps || !buf || !(f = fopen(path, "wb")))
+        {
+            close();
+            return false;
+        }
+        // Placeholder header, rewritten by close(); indexOffset 0 marks an unfinished log.
+        return fwrite(&hdr, sizeof(hdr), 1, f) == 1 || fail();
+    }
+
+    /**
+     * Append one row.
+     *
+     * @param stamp Timestamp (microseconds, by convention).
+     * @param s     Gyro, accel and mag, may be NULL.
+     * @param q     Attitude, may be NULL.
+     */
+    bool append(uint64_t stamp, const ImuSample<T> * s, const Quaternion<T> * q)
+    {
+        if (!f) return false;
+
+        stamps[fill] = stamp;
+        for (int c = 0; c < cols; c++) buf[c * stride + fill] = 0;
+        if (s)
+        {
+            put(LOG_GYRO,  s->gyro);
+            put(LOG_ACCEL, s->accel);
+            put(LOG_MAG,   s->mag);
+        }
+        if (q)
+        {
+            const int c = detail::logColumn(hdr.channels, LOG_ATTITUDE);
+
+            if (c >= 0)
+            {
+                buf[(c + 0) * stride + fill] = q->W();
+                buf[(c + 1) * stride + fill] = q->X();
+                buf[(c + 2) * stride + fill] = q->Y();
+                buf[(c + 3) * stride + fill] = q->Z();
+            }
+        }
+        return (++fill < hdr.chunkRows) || flush();
+    }
+
+    bool append(const ImuSample<T> & s)                          { return append(s.stamp, &s, NULL); };
+    bool append(const ImuSample<T> & s, const Quaternion<T> & q) { return append(s.stamp, &s, &q); };
+    bool append(uint64_t stamp, const Quaternion<T> & q)         { return append(stamp, NULL, &q); };
+
+    /**
+     * Write the last chunk, the index and the final header.
+     */
+    bool close(void)
+    {
+        bool ok = true;
+
+        if (f)
+        {
+            ok = flush();
+            if (ok)
+            {
+                hdr.indexOffset = pos();
+                ok = (index.empty() || fwrite(&index[0], sizeof(index[0]), index.size(), f) == index.size()) &&
+                     fseek(f, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+            }
+            if (f)
+            {
+                ok = (fclose(f) == 0) && ok;
+                f = NULL;
+            }
+        }
+        free(stamps), stamps = NULL;
+        free(buf),    buf    = NULL;
+        index.clear();
+
+        return ok;
+    }
+
+    /** Rows appended so far.
+     */
+    uint64_t rows(void) const { return hdr.rows + fill; };
+
+    private:
+
+    void put(ImuLogChannel ch, const Vector3D<T> & v)
+    {
+        const int c = detail::logColumn(hdr.channels, ch);
+
+        if (c < 0) return;
+        buf[(c + 0) * stride + fill] = v.X();
+        buf[(c + 1) * stride + fill] = v.Y();
+        buf[(c + 2) * stride + fill] = v.Z();
+    }
+
+    uint64_t pos(void) { return (uint64_t)ftello(f); };
+
+    bool fail(void) { fclose(f); f = NULL; close(); return false; };
+
+    bool pad(size_t used, size_t to)
+    {
+        static const char zero[64] = { 0 };
+        return to == used || fwrite(zero, 1, to - used, f) == to - used;
+    }
+
+    /** Write the buffered rows as one chunk.
+     */
+    bool flush(void)
+    {
+        detail::LogChunkHeader ch;
+        detail::LogIndexEntry  e;
+
+        if (!fill) return true;
+
+        memset(&ch, 0, sizeof(ch));
+        ch.magic      = detail::LOG_CHUNK_MAGIC;
+        ch.rows       = fill;
+        ch.firstRow   = hdr.rows;
+        ch.firstStamp = stamps[0];
+        ch.lastStamp  = stamps[fill - 1];
+        ch.bytes      = detail::logChunkBytes(hdr.channels, sizeof(T), fill);
+
+        memset(&e, 0, sizeof(e));
+        e.offset     = pos();
+        e.firstRow   = ch.firstRow;
+        e.firstStamp = ch.firstStamp;
+        e.lastStamp  = ch.lastStamp;
+        e.rows       = fill;
+
+        bool ok = fwrite(&ch, sizeof(ch), 1, f) == 1 &&
+                  fwrite(stamps, sizeof(uint64_t), fill, f) == fill &&
+                  pad(fill * sizeof(uint64_t), detail::align64(fill * sizeof(uint64_t)));
+        for (int c = 0; ok && c < cols; c++)
+        {
+            ok = fwrite(buf + c * stride, sizeof(T), fill, f) == fill &&
+                 pad(fill * sizeof(T), detail::align64(fill * sizeof(T)));
+        }
+        if (!ok) return fail();
+        index.push_back(e);
+
+        hdr.rows   += fill;
+        hdr.chunks += 1;
+        fill = 0;
+        return true;
+    }
+
+    FILE              * f;
+    detail::LogHeader   hdr;
+    uint64_t          * stamps;
+    T                 * buf;
+    size_t              stride;
+    int                 cols;
+    uint32_t            fill;
+
+    std::vector<detail::LogIndexEntry> index;
+}; // class ImuLogWriter
+
+/** @class ImuLogChunk
+*
+* Zero-copy view of one chunk of a mapped log.
+*/
+template <typename T>
+class ImuLogChunk
+{
+    public:
+
+    ImuLogChunk(void) : base(NULL), rows(0), channels(0) {};
+    ImuLogChunk(const char * base, size_t rows, uint32_t channels) : base(base), rows(rows), channels(channels) {};
+
+    size_t            size(void)  const { return rows; };
+    const uint64_t  * stamp(void) const { return (const uint64_t *)(base + sizeof(detail::LogChunkHeader)); };
+
+    /** Vector channel columns, an empty span if the log does not have it.
+     */
+    Vector3DSpan<T>   gyro(void)  const { return vec(LOG_GYRO); };
+    Vector3DSpan<T>   accel(void) const { return vec(LOG_ACCEL); };
+    Vector3DSpan<T>   mag(void)   const { return vec(LOG_MAG); };
+
+    /** Attitude columns, an empty span if the log does not have them.
+     */
+    QuaternionSpan<T> attitude(void) const
+    {
+        const int c = detail::logColumn(channels, LOG_ATTITUDE);
+
+        if (c < 0) return QuaternionSpan<T>();
+        return QuaternionSpan<T>(column(c), column(c + 1), column(c + 2), column(c + 3), rows);
+    }
+
+    /** Row i as an ImuSample (copies).
+     */
+    ImuSample<T>      sample(size_t i) const
+    {
+        const Vector3D<T> zero;
+        const Vector3DSpan<T> g = gyro(), a = accel(), m = mag();
+
+        return ImuSample<T>(stamp()[i], g.n ? g[i] : zero, a.n ? a[i] : zero, m.n ? m[i] : zero);
+    }
+
+    private:
+
+    const T * column(int c) const
+    {
+        return (const T *)(base + sizeof(detail::LogChunkHeader) + detail::align64(rows * sizeof(uint64_t)) + c * detail::align64(rows * sizeof(T)));
+    }
+
+    Vector3DSpan<T> vec(ImuLogChannel ch) const
+    {
+        const int c = detail::logColumn(channels, ch);
+
+        if (c < 0) return Vector3DSpan<T>();
+        return Vector3DSpan<T>(column(c), column(c + 1), column(c + 2), rows);
+    }
+
+    const char * base;
+    size_t       rows;
+    uint32_t     channels;
+}; // class ImuLogChunk
+
+/** @class ImuLogReader
+*
+* Maps a log read-only and hands out zero-copy chunk views.  Views stay
+* valid until close().
+*/
+template <typename T>
+class ImuLogReader
+{
+    public:
+
+    ImuLogReader(void) : map(NULL), bytes(0), index(NULL), count(0), rebuilt(false), total(0), channelMask(0) {};
+    ~ImuLogReader(void) { close(); };
+
+    ImuLogReader(const ImuLogReader<T> &) = delete;
+    ImuLogReader<T> & operator = (const ImuLogReader<T> &) = delete;
+
+    /**
+     * Map a log.
+     *
+     * @return false if the file cannot be mapped, is not a log, has another
+     *         version, byte order or scalar type than T.
+     */
+    bool open(const char * path)
+    {
+        struct stat st;
+        int fd;
+
+        close();
+        if ((fd = ::open(path, O_RDONLY)) < 0) return false;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(detail::LogHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        bytes = st.st_size;
+        map = (const char *)mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == (const char *)MAP_FAILED)
+        {
+            map = NULL;
+            return false;
+        }
+        madvise((void *)map, bytes, MADV_SEQUENTIAL);
+
+        const detail::LogHeader * h = (const detail::LogHeader *)map;
+
+        if (memcmp(h->magic, detail::LOG_MAGIC, sizeof(h->magic)) != 0 || h->version != IMU_LOG_VERSION ||
+            h->byteOrder != detail::LOG_BYTE_ORDER || h->scalarSize != sizeof(T) || !h->chunkRows)
+        {
+            close();
+            return false;
+        }
+        channelMask = h->channels;
+
+        if (checkIndex(h)) return true;
+        return recover(h->chunkRows);
+    }
+
+    void close(void)
+    {
+        if (map) munmap((void *)map, bytes);
+        std::vector<detail::LogIndexEntry>().swap(owned);
+        map = NULL, bytes = 0, index = NULL, count = 0, rebuilt = false, total = 0, channelMask = 0;
+    }
+
+    /** True if the index had to be rebuilt (the writer did not close(), or
+     *  the index was damaged).
+     */
+    bool            recovered(void) const { return rebuilt; };
+
+    uint32_t        channels(void)  const { return channelMask; };
+    uint64_t        rows(void)      const { return total; };
+    size_t          chunks(void)    const { return count; };
+
+    /** Chunk i, 0 <= i < chunks().
+     */
+    ImuLogChunk<T>  chunk(size_t i) const { return ImuLogChunk<T>(map + index[i].offset, index[i].rows, channelMask); };
+
+    /** First row number and timestamp range of chunk i.
+     */
+    uint64_t        chunkFirstRow(size_t i)   const { return index[i].firstRow; };
+    uint64_t        chunkFirstStamp(size_t i) const { return index[i].firstStamp; };
+    uint64_t        chunkLastStamp(size_t i)  const { return index[i].lastStamp; };
+
+    /**
+     * Chunk holding the first row stamped at or after t (timestamps are
+     * assumed non-decreasing).  Returns chunks() if there is none.
+     */
+    size_t          findChunk(uint64_t t) const
+    {
+        size_t lo = 0, hi = count;
+
+        while (lo < hi)
+        {
+            const size_t mid = lo + (hi - lo) / 2;
+
+            if (index[mid].lastStamp < t) lo = mid + 1;
+            else                          hi = mid;
+        }
+        return lo;
+    }
+
+    private:
+
+    /**
+     * Use the index written by close() if every entry points at a whole
+     * chunk inside the file, with the rows the entry claims, and the
+     * chunks follow each other.  Sizes are
+     * compared against what is left of the file so nothing can overflow.
+     */
+    bool checkIndex(const detail::LogHeader * h)
+    {
+        const uint64_t off = h->indexOffset;
+
+        if (!off || off % 64 || off > bytes || h->chunks > (bytes - off) / sizeof(detail::LogIndexEntry)) return false;
+
+        const detail::LogIndexEntry * e = (const detail::LogIndexEntry *)(map + off);
+        uint64_t rows = 0;
+
+        for (uint64_t i = 0; i < h->chunks; i++)
+        {
+            if (!chunkFits(e[i].offset, e[i].rows, h->chunkRows)) return false;
+
+            const detail::LogChunkHeader * ch = (const detail::LogChunkHeader *)(map + e[i].offset);
+
+            if (ch->magic != detail::LOG_CHUNK_MAGIC || ch->rows != e[i].rows || e[i].firstRow != rows || ch->firstRow != rows) return false;
+            rows += e[i].rows;
+        }
+        if (rows != h->rows) return false;
+
+        index = e;
+        count = h->chunks;
+        total = h->rows;
+        return true;
+    }
+
+    /** A chunk of rows rows at off is 64 byte aligned, past the header and inside the file.
+     */
+    bool chunkFits(uint64_t off, uint32_t rows, uint32_t chunkRows) const
+    {
+        return !(off % 64) && off >= sizeof(detail::LogHeader) && off <= bytes && rows && rows <= chunkRows &&
+               detail::logChunkBytes(channelMask, sizeof(T), rows) <= bytes - off;
+    }
+
+    /** Rebuild the index from the chunk headers, up to the first incomplete chunk.
+     */
+    bool recover(uint32_t chunkRows)
+    {
+        uint64_t off = sizeof(detail::LogHeader);
+
+        while (off + sizeof(detail::LogChunkHeader) <= bytes)
+        {
+            const detail::LogChunkHeader * ch = (const detail::LogChunkHeader *)(map + off);
+            detail::LogIndexEntry          e;
+
+            if (ch->magic != detail::LOG_CHUNK_MAGIC || !chunkFits(off, ch->rows, chunkRows) ||
+                ch->bytes != detail::logChunkBytes(channelMask, sizeof(T), ch->rows))
+            {
+                break;
+            }
+            e.offset     = off;
+            e.firstRow   = ch->firstRow;
+            e.firstStamp = ch->firstStamp;
+            e.lastStamp  = ch->lastStamp;
+            e.rows       = ch->rows;
+            e.reserved   = 0;
+            owned.push_back(e);
+            total += ch->rows;
+            off += ch->bytes;
+        }
+        index   = owned.empty() ? NULL : &owned[0];
+        count   = owned.size();
+        rebuilt = true;
+        return true;
+    }
+
+    const char                  * map;
+    size_t                        bytes;
+    const detail::LogIndexEntry * index;
+    size_t                        count;
+    bool                          rebuilt;
+    uint64_t                      total;
+    uint32_t                      channelMask;
+
+    std::vector<detail::LogIndexEntry> owned;   // index rebuilt by recover()
+}; // class ImuLogReader
+
+}; // namespace IMU
+
+#endif //__IMU_LOG_H__
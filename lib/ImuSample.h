@@ -0,0 +1,45 @@
+#ifndef __IMU_SAMPLE_H__
+#define __IMU_SAMPLE_H__
+
+#include <stdint.h>
+
+#include <Vector3D.h>
+
+namespace IMU
+{
+
+/** @class ImuSample
+*
+* One timestamped gyro/accel/mag reading.
+*
+* Units are whatever the consumer expects; the attitude filters take the gyro
+* in rad/s and only care about the direction of accel and mag.  A sensor
+* without a magnetometer leaves mag at zero.
+*/
+template <typename T>
+struct ImuSample
+{
+    /** Default constructor, everything zero.
+     */
+    ImuSample(void) : stamp(0) {};
+
+    /**
+     * Construct from readings.
+     *
+     * @param stamp Sample time in microseconds.
+     * @param gyro  Angular rate.
+     * @param accel Specific force.
+     * @param mag   Magnetic field, zero if not available.
+     */
+    ImuSample(uint64_t stamp, const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag = Vector3D<T>())
+        : stamp(stamp), gyro(gyro), accel(accel), mag(mag) {};
+
+    uint64_t    stamp;
+    Vector3D<T> gyro;
+    Vector3D<T> accel;
+    Vector3D<T> mag;
+}; // struct ImuSample
+
+}; // namespace IMU
+
+#endif //__IMU_SAMPLE_H__
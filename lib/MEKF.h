@@ -0,0 +1,340 @@
+#ifndef __MEKF_H__
+#define __MEKF_H__
+
+#include <stddef.h>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <ImuSample.h>
+#include <FastMath.h>
+#include <MathPolicy.h>
+#include <Matrix.h>
+
+namespace IMU
+{
+
+/** @class MEKF
+*
+* Multiplicative extended Kalman filter for attitude and gyro bias.
+*
+* The attitude itself is kept as a unit Quaternion<T>, same convention as
+* MadgwickAHRS (body to earth, gVec() is the gravity direction in the body
+* frame).  The filter state is only the 6-vector of a body frame rotation
+* error and a gyro bias correction; after every update the error is folded
+* into the quaternion and reset to zero, so the quaternion never needs a
+* norm constraint inside the filter.
+*
+* All matrices are fixed size Matrix<> on the stack.  One predict() is two
+* 6x6 products, one vector update is a 3x3 Cholesky and a handful of 6x3
+* products that use the sparsity of the measurement Jacobian.
+*
+* Accel and mag only contribute their direction.  The mag reference is
+* rebuilt from every measurement the way MadgwickAHRS does it (horizontal
+* plus vertical component in the earth frame), so mag corrects heading and
+* leaves tilt to the accel.
+*/
+template <typename T>
+class MEKF
+{
+    public:
+
+    typedef Matrix<T, 6, 6> Covariance;
+
+    /** @class Step
+    *
+    * One record of the forward pass kept by smooth().  After smooth() the
+    * attitude, bias and covariance members hold the smoothed estimate.
+    */
+    struct Step
+    {
+        Quaternion<T> attitude;         // filtered, then smoothed
+        Vector3D<T>   bias;
+        Covariance    covariance;
+        Quaternion<T> priorAttitude;    // after predict(), before the updates
+        Vector3D<T>   priorBias;
+        Covariance    priorCovariance;
+        Covariance    transition;       // error transition from the previous step
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param rate       Sample rate in Hz, used by update() and smooth().
+     * @param gyroNoise  Gyro white noise density, rad/s/sqrt(Hz).
+     * @param biasNoise  Gyro bias random walk, rad/s^2/sqrt(Hz).
+     * @param accelNoise Standard deviation of the normalized accel direction.
+     * @param magNoise   Standard deviation of the normalized mag direction.
+     */
+    MEKF(const T & rate, const T & gyroNoise, const T & biasNoise, const T & accelNoise, const T & magNoise)
+        : dt(1 / rate), gyroVar(gyroNoise * gyroNoise), biasVar(biasNoise * biasNoise),
+          accelVar(accelNoise * accelNoise), magVar(magNoise * magNoise), phi(Covariance::identity())
+    {
+        reset();
+    };
+
+    /**
+     * Restart from a given state.
+     *
+     * @param att       Initial attitude, must be normalized.
+     * @param b         Initial gyro bias.
+     * @param attSigma  Initial attitude uncertainty, rad.
+     * @param biasSigma Initial bias uncertainty, rad/s.
+     */
+    void reset(const Quaternion<T> & att = Quaternion<T>(), const Vector3D<T> & b = Vector3D<T>(),
+               const T & attSigma = T(1) / 2, const T & biasSigma = T(1) / 20);
+
+    const Quaternion<T> & attitude(void)   const { return q; };
+    const Vector3D<T>   & bias(void)       const { return b; };
+    const Covariance    & covariance(void) const { return P; };
+
+    /**
+     * Propagate with one gyro sample.
+     *
+     * @param gyro Angular rate in rad/s, bias not removed.
+     * @param dt   Time step in seconds.
+     */
+    void predict(const Vector3D<T> & gyro, const T & dt);
+
+    /**
+     * Correct with a measured direction of a known earth frame vector.
+     *
+     * @param measured  Body frame measurement, only the direction is used.
+     * @param reference Earth frame vector, only the direction is used.
+     * @param variance  Variance of each component of the normalized measurement.
+     *
+     * @return false (nothing changed) for a zero measurement or a degenerate innovation.
+     */
+    bool correct(const Vector3D<T> & measured, const Vector3D<T> & reference, const T & variance);
+
+    /** Correct with the accel direction against gravity (earth z).
+     */
+    bool correctAccel(const Vector3D<T> & accel) { return correct(accel, Vector3D<T>(0, 0, 1), accelVar); };
+
+    /** Correct the heading with the mag direction.
+     */
+    bool correctMag(const Vector3D<T> & mag);
+
+    /**
+     * Process one sample at the configured rate: predict, then the accel and
+     * mag corrections.  Zero accel or mag skip their correction.
+     */
+    void update(const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag = Vector3D<T>());
+
+    /**
+     * Process one sample record.
+     */
+    void update(const ImuSample<T> & s) { update(s.gyro, s.accel, s.mag); };
+
+    /**
+     * Process n consecutive sample records.
+     */
+    void update(const ImuSample<T> * s, size_t n) { for (size_t i = 0; i < n; i++) update(s[i].gyro, s[i].accel, s[i].mag); };
+
+    /**
+     * Offline forward filter plus Rauch-Tung-Striebel smoother.
+     *
+     * Runs update() over the samples from the current state, keeping every
+     * step in the caller's storage, then sweeps backwards.  The filter is
+     * left at the end of the forward pass, which is also the last smoothed
+     * step.
+     *
+     * @param s     Samples, oldest first.
+     * @param n     Number of samples.
+     * @param steps n records, filled with the smoothed estimates.
+     *
+     * @return false if a backward step hit a singular prior covariance; that
+     *         step and every earlier one keep their filtered estimate.
+     */
+    bool smooth(const ImuSample<T> * s, size_t n, Step * steps);
+
+    protected:
+
+    static Quaternion<T> & applyError(Quaternion<T> & att, const T & ex, const T & ey, const T & ez);
+
+    Quaternion<T> q;
+    Vector3D<T>   b;
+    Covariance    P;
+
+    T             dt;
+    T             gyroVar;
+    T             biasVar;
+    T             accelVar;
+    T             magVar;
+    Covariance    phi;      // transition of the last predict(), kept for smooth()
+}; // class MEKF
+
+template <typename T>
+void
+MEKF<T>::reset(const Quaternion<T> & att, const Vector3D<T> & bias, const T & attSigma, const T & biasSigma)
+{
+    q = att;
+    b = bias;
+    P = Covariance();
+    for (int i = 0; i < 3; i++)
+    {
+        P(i, i)         = attSigma * attSigma;
+        P(i + 3, i + 3) = biasSigma * biasSigma;
+    }
+}
+
+template <typename T>
+Quaternion<T> &
+MEKF<T>::applyError(Quaternion<T> & att, const T & ex, const T & ey, const T & ez)
+{
+    // Small angle error quaternion (1, e/2), renormalized with the product.
+    const T half = T(1) / 2;
+
+    att *= Quaternion<T>(1, half * ex, half * ey, half * ez);
+    return att *= rsqrt(att.W() * att.W() + att.X() * att.X() + att.Y() * att.Y() + att.Z() * att.Z());
+}
+
+template <typename T>
+void
+MEKF<T>::predict(const Vector3D<T> & gyro, const T & dt)
+{
+    const Vector3D<T> w = (gyro - b) * dt;
+    const T angle = PreciseMath::sqrt(w.dot(w));
+
+    // Attitude: exact exponential of the bias corrected rotation.
+    if (angle > T(1e-12))
+    {
+        const T s = PreciseMath::sin(angle / 2) / angle;
+
+        q *= Quaternion<T>(PreciseMath::cos(angle / 2), s * w.X(), s * w.Y(), s * w.Z());
+    }
+
+    // Error transition [ exp(-[w x])  -I dt ; 0  I ], second order in the rotation.
+    const Matrix<T, 3, 3> S = skew(w);
+    const Matrix<T, 3, 3> A = Matrix<T, 3, 3>::identity() - S + S * S * (T(1) / 2);
+
+    phi.setBlock(0, 0, A);
+    phi.setBlock(0, 3, Matrix<T, 3, 3>::diagonal(-dt));
+
+    // P = phi P phi' + Q by 3x3 blocks, a third of the work of the full product.
+    const Matrix<T, 3, 3> P11 = P.template block<3, 3>(0, 0);
+    const Matrix<T, 3, 3> P12 = P.template block<3, 3>(0, 3);
+    Matrix<T, 3, 3>       P22 = P.template block<3, 3>(3, 3);
+    const Matrix<T, 3, 3> AP12 = A * P12;
+    Matrix<T, 3, 3>       N11 = A * P11 * A.transpose() - (AP12 + AP12.transpose()) * dt + P22 * (dt * dt);
+    const Matrix<T, 3, 3> N12 = AP12 - P22 * dt;
+
+    for (int i = 0; i < 3; i++)
+    {
+        N11(i, i) += gyroVar * dt;
+        P22(i, i) += biasVar * dt;
+    }
+    P.setBlock(0, 0, N11.symmetrize());
+    P.setBlock(0, 3, N12);
+    P.setBlock(3, 0, N12.transpose());
+    P.setBlock(3, 3, P22);
+}
+
+template <typename T>
+bool
+MEKF<T>::correct(const Vector3D<T> & measured, const Vector3D<T> & reference, const T & variance)
+{
+    const T mm = measured.dot(measured), rr = reference.dot(reference);
+
+    if (!(mm > 0) || !(rr > 0)) return false;
+
+    const Vector3D<T> z = measured * rsqrt(mm);
+    const Vector3D<T> h = q.conj().rot(reference * rsqrt(rr));
+
+    // H = [ [h x]  0 ], only the first three columns of P take part.
+    const Matrix<T, 3, 3> Hs = skew(h);
+    const Matrix<T, 6, 3> PHt = P.template block<6, 3>(0, 0) * Hs.transpose();
+    Matrix<T, 3, 3> S = Hs * PHt.template block<3, 3>(0, 0);
+
+    for (int i = 0; i < 3; i++) S(i, i) += variance;
+
+    // K' = S^-1 (P H')'
+    Matrix<T, 3, 6> Kt = PHt.transpose();
+
+    if (!solveSPD(S, Kt)) return false;
+
+    const Matrix<T, 6, 3> K = Kt.transpose();
+    const Matrix<T, 6, 1> dx = K * column(z - h);
+
+    applyError(q, dx(0, 0), dx(1, 0), dx(2, 0));
+    b += vector3D(dx, 3);
+
+    // P = (I - K H) P = P - K (P H')'
+    P -= K * PHt.transpose();
+    P.symmetrize();
+    return true;
+}
+
+template <typename T>
+bool
+MEKF<T>::correctMag(const Vector3D<T> & mag)
+{
+    if (mag.X() == 0 && mag.Y() == 0 && mag.Z() == 0) return false;
+
+    // Earth frame reference with the measurement's own dip: only heading is observable.
+    const Vector3D<T> e = q.rot(mag);
+
+    return correct(mag, Vector3D<T>(PreciseMath::sqrt(e.X() * e.X() + e.Y() * e.Y()), 0, e.Z()), magVar);
+}
+
+template <typename T>
+void
+MEKF<T>::update(const Vector3D<T> & gyro, const Vector3D<T> & accel, const Vector3D<T> & mag)
+{
+    predict(gyro, dt);
+    correctAccel(accel);
+    correctMag(mag);
+}
+
+template <typename T>
+bool
+MEKF<T>::smooth(const ImuSample<T> * s, size_t n, Step * steps)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        Step & st = steps[i];
+
+        predict(s[i].gyro, dt);
+        st.priorAttitude   = q;
+        st.priorBias       = b;
+        st.priorCovariance = P;
+        st.transition      = phi;
+
+        correctAccel(s[i].accel);
+        correctMag(s[i].mag);
+        st.attitude   = q;
+        st.bias       = b;
+        st.covariance = P;
+    }
+    if (n < 2) return true;
+
+    for (size_t k = n - 1; k-- > 0; )
+    {
+        Step & cur = steps[k];
+        const Step & next = steps[k + 1];
+
+        // Gain C = Pf F' Pp^-1, solved as C' = Pp^-1 (F Pf).
+        Covariance Ct = next.transition * cur.covariance;
+
+        if (!solveSPD(next.priorCovariance, Ct)) return false;
+
+        // Smoothed minus predicted at k+1, as an error state.
+        Quaternion<T> dq = next.priorAttitude.conj() * next.attitude;
+
+        if (dq.W() < 0) dq *= T(-1);
+
+        T d[6] = { 2 * dq.X(), 2 * dq.Y(), 2 * dq.Z(),
+                   next.bias.X() - next.priorBias.X(), next.bias.Y() - next.priorBias.Y(), next.bias.Z() - next.priorBias.Z() };
+        const Matrix<T, 6, 6> C = Ct.transpose();
+        const Matrix<T, 6, 1> dx = C * Matrix<T, 6, 1>(d);
+
+        applyError(cur.attitude, dx(0, 0), dx(1, 0), dx(2, 0));
+        cur.bias += vector3D(dx, 3);
+        cur.covariance += C * (next.covariance - next.priorCovariance) * Ct;
+        cur.covariance.symmetrize();
+    }
+    return true;
+}
+
+}; // namespace IMU
+
+#endif //__MEKF_H__
@@ -0,0 +1,180 @@
+#ifndef __MATH_POLICY_H__
+#define __MATH_POLICY_H__
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <FastMath.h>
+
+namespace IMU
+{
+
+/**
+ * Type exact math.h functions.
+ *
+ * C math.h only has the double versions under the plain names, so depending
+ * on the toolchain sqrt(float) can quietly promote.  These overloads pin
+ * float to the f suffixed functions and long double to the l suffixed ones.
+ */
+namespace math
+{
+
+inline float       sqrt (float x)                      { return ::sqrtf(x); };
+inline double      sqrt (double x)                     { return ::sqrt(x); };
+inline long double sqrt (long double x)                { return ::sqrtl(x); };
+inline float       pow  (float x, float y)             { return ::powf(x, y); };
+inline double      pow  (double x, double y)           { return ::pow(x, y); };
+inline long double pow  (long double x, long double y) { return ::powl(x, y); };
+inline float       exp  (float x)                      { return ::expf(x); };
+inline double      exp  (double x)                     { return ::exp(x); };
+inline long double exp  (long double x)                { return ::expl(x); };
+inline float       log  (float x)                      { return ::logf(x); };
+inline double      log  (double x)                     { return ::log(x); };
+inline long double log  (long double x)                { return ::logl(x); };
+inline float       fabs (float x)                      { return ::fabsf(x); };
+inline double      fabs (double x)                     { return ::fabs(x); };
+inline long double fabs (long double x)                { return ::fabsl(x); };
+inline float       sin  (float x)                      { return ::sinf(x); };
+inline double      sin  (double x)                     { return ::sin(x); };
+inline long double sin  (long double x)                { return ::sinl(x); };
+inline float       cos  (float x)                      { return ::cosf(x); };
+inline double      cos  (double x)                     { return ::cos(x); };
+inline long double cos  (long double x)                { return ::cosl(x); };
+inline float       tan  (float x)                      { return ::tanf(x); };
+inline double      tan  (double x)                     { return ::tan(x); };
+inline long double tan  (long double x)                { return ::tanl(x); };
+inline float       asin (float x)                      { return ::asinf(x); };
+inline double      asin (double x)                     { return ::asin(x); };
+inline long double asin (long double x)                { return ::asinl(x); };
+inline float       atan2(float y, float x)             { return ::atan2f(y, x); };
+inline double      atan2(double y, double x)           { return ::atan2(y, x); };
+inline long double atan2(long double y, long double x) { return ::atan2l(y, x); };
+
+}; // namespace math
+
+/** @class PreciseMath
+*
+* Default math policy: the math.h function of exactly the argument type.
+*
+* float, double and long double go to the matching math::* overload, any
+* other T (Fixed, Dual, ...) to the function found by argument dependent
+* lookup.
+*/
+struct PreciseMath
+{
+    template <typename T> static T sqrt (const T & x)             { using math::sqrt;  return sqrt(x); };
+    template <typename T> static T rsqrt(const T & x)             { using math::sqrt;  return 1 / sqrt(x); };
+    template <typename T> static T pow  (const T & x, const T & y){ using math::pow;   return pow(x, y); };
+    template <typename T> static T exp  (const T & x)             { using math::exp;   return exp(x); };
+    template <typename T> static T log  (const T & x)             { using math::log;   return log(x); };
+    template <typename T> static T fabs (const T & x)             { using math::fabs;  return fabs(x); };
+    template <typename T> static T sin  (const T & x)             { using math::sin;   return sin(x); };
+    template <typename T> static T cos  (const T & x)             { using math::cos;   return cos(x); };
+    template <typename T> static T tan  (const T & x)             { using math::tan;   return tan(x); };
+    template <typename T> static T asin (const T & x)             { using math::asin;  return asin(x); };
+    template <typename T> static T atan2(const T & y, const T & x){ using math::atan2; return atan2(y, x); };
+}; // struct PreciseMath
+
+/** @class ApproxMath
+*
+* Opt-in fast math policy.
+*
+* Replaces sqrt, rsqrt, pow, exp and log for float and double with
+* approximations, everything else (and every other T) is PreciseMath.
+* Maximum errors over the whole normal float range:
+*
+*   rsqrt, sqrt     relative 3.1e-7 (float, SSE), 4.8e-6 (float, no SSE),
+*                   4.1e-16 (double).  sqrt(0) is 0.
+*   exp             relative 1.5e-7 * (1 + |x|)
+*   log             absolute 5.0e-7 + 1.2e-7 * |log(x)|
+*   pow (x > 0)     relative 1.5e-7 + 4.7e-7 * |y| * (1 + |log2(x)|)
+*
+* exp, log and pow are evaluated in float precision for double arguments as
+* well.  pow falls back to PreciseMath for x <= 0.
+*/
+struct ApproxMath : public PreciseMath
+{
+    using PreciseMath::sqrt;
+    using PreciseMath::rsqrt;
+    using PreciseMath::pow;
+    using PreciseMath::exp;
+    using PreciseMath::log;
+
+    static float  rsqrt(float x)  { return IMU::rsqrt(x); };
+    static double rsqrt(double x) { return IMU::rsqrt(x); };
+    static float  sqrt (float x)  { return (x > 0) ? x * IMU::rsqrt(x) : 0; };
+    static double sqrt (double x) { return (x > 0) ? x * IMU::rsqrt(x) : 0; };
+
+    static float  exp  (float x)  { return exp2f(x * 1.44269504f); };
+    static double exp  (double x) { return exp2f((float)x * 1.44269504f); };
+    static float  log  (float x)  { return log2f(x) * 0.693147181f; };
+    static double log  (double x) { return log2f((float)x) * 0.693147181f; };
+
+    static float  pow  (float x, float y)   { return (x > 0) ? exp2f(y * log2f(x)) : PreciseMath::pow(x, y); };
+    static double pow  (double x, double y) { return (x > 0) ? exp2f((float)(y * log2f((float)x))) : PreciseMath::pow(x, y); };
+
+    /**
+     * 2^x, degree 5 polynomial on the fraction, exponent by bit insertion.
+     */
+    static float exp2f(float x)
+    {
+        int32_t i;
+        float f, p;
+        uint32_t bits;
+
+        if (x >  127.0f) return HUGE_VALF;
+        if (x < -126.0f) return 0;
+
+        i = (int32_t)x - (x < 0);
+        f = x - (float)i;
+        p = 1.87757395e-3f;
+        p = p * f + 8.98934668e-3f;
+        p = p * f + 5.58263125e-2f;
+        p = p * f + 2.40153619e-1f;
+        p = p * f + 6.93153073e-1f;
+        p = p * f + 9.99999925e-1f;
+
+        memcpy(&bits, &p, sizeof(bits));
+        bits += (uint32_t)i << 23;
+        memcpy(&p, &bits, sizeof(p));
+
+        return p;
+    };
+
+    /**
+     * log2(x) for x > 0, exponent by bit extraction, degree 7 polynomial
+     * in t = m - 1 for the mantissa m in [sqrt(1/2), sqrt(2)).
+     */
+    static float log2f(float x)
+    {
+        uint32_t bits;
+        int32_t e;
+        float m, t, p;
+
+        memcpy(&bits, &x, sizeof(bits));
+        e     = (int32_t)((bits >> 23) & 0xff) - 127;
+        bits  = (bits & 0x007fffff) | 0x3f800000;
+        memcpy(&m, &bits, sizeof(m));
+        if (m > 1.41421356f)
+        {
+            m *= 0.5f;
+            e += 1;
+        }
+
+        t = m - 1.0f;
+        p = 0.176158430f;
+        p = p * t - 0.270974533f;
+        p = p * t + 0.295100969f;
+        p = p * t - 0.359185127f;
+        p = p * t + 0.480648656f;
+        p = p * t - 0.721367687f;
+        p = p * t + 1.442696307f;
+
+        return (float)e + t * p;
+    };
+}; // struct ApproxMath
+
+}; // namespace IMU
+
+#endif //__MATH_POLICY_H__
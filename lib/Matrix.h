@@ -0,0 +1,234 @@
+#ifndef __MATRIX_H__
+#define __MATRIX_H__
+
+#include <MathPolicy.h>
+#include <Vector3D.h>
+
+// Fixed trip counts are not enough at -O2, ask for the unrolling explicitly.
+#if defined(__clang__)
+#define IMU_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define IMU_UNROLL _Pragma("GCC unroll 64")
+#else
+#define IMU_UNROLL
+#endif
+
+namespace IMU
+{
+
+/** @class Matrix
+*
+* Dense R x C matrix of T with the size fixed at compile time.
+*
+* Row-major storage inside the object, no heap.  All loop bounds are
+* compile-time constants and marked IMU_UNROLL, so for the small sizes used
+* by the filters they unroll completely.  Meant for 3x3 .. ~12x12 filter algebra,
+* not for large linear algebra.
+*/
+template <typename T, int R, int C>
+class Matrix
+{
+    public:
+
+    /** Default constructor, all zero.
+     */
+    Matrix(void) { IMU_UNROLL for (int i = 0; i < R * C; i++) m[i] = 0; };
+
+    /**
+     * Construct from a row-major array.
+     *
+     * @param a pointer to R * C values of type T
+     */
+    explicit Matrix(const T * a) __attribute__((__nonnull__)) { IMU_UNROLL for (int i = 0; i < R * C; i++) m[i] = a[i]; };
+
+    /** Identity (square matrices; for others the leading diagonal is 1).
+     */
+    static Matrix<T, R, C> identity(void)
+    {
+        Matrix<T, R, C> res;
+        IMU_UNROLL
+        for (int i = 0; i < R && i < C; i++) res(i, i) = 1;
+        return res;
+    }
+
+    /** Diagonal matrix with every diagonal element set to d.
+     */
+    static Matrix<T, R, C> diagonal(const T & d) { Matrix<T, R, C> res = identity(); return res *= d; };
+
+    static int  rows(void) { return R; };
+    static int  cols(void) { return C; };
+
+    T           operator () (int r, int c) const { return m[r * C + c]; };
+    T         & operator () (int r, int c)       { return m[r * C + c]; };
+    const T   * data(void)                 const { return m; };
+
+    /** Transposed copy.
+     */
+    Matrix<T, C, R> transpose(void) const
+    {
+        Matrix<T, C, R> res;
+        IMU_UNROLL
+        for (int r = 0; r < R; r++)
+            IMU_UNROLL
+            for (int c = 0; c < C; c++)
+                res(c, r) = m[r * C + c];
+        return res;
+    }
+
+    /** Copy of the BR x BC block starting at (r, c).
+     */
+    template <int BR, int BC>
+    Matrix<T, BR, BC> block(int r, int c) const
+    {
+        Matrix<T, BR, BC> res;
+        IMU_UNROLL
+        for (int i = 0; i < BR; i++)
+            IMU_UNROLL
+            for (int j = 0; j < BC; j++)
+                res(i, j) = m[(r + i) * C + c + j];
+        return res;
+    }
+
+    /** Overwrite the block starting at (r, c) with b.
+     */
+    template <int BR, int BC>
+    Matrix<T, R, C> & setBlock(int r, int c, const Matrix<T, BR, BC> & b)
+    {
+        IMU_UNROLL
+        for (int i = 0; i < BR; i++)
+            IMU_UNROLL
+            for (int j = 0; j < BC; j++)
+                m[(r + i) * C + c + j] = b(i, j);
+        return *this;
+    }
+
+    /** Make a square matrix exactly symmetric, (A + A') / 2.
+     */
+    Matrix<T, R, C> & symmetrize(void)
+    {
+        IMU_UNROLL
+        for (int r = 0; r < R; r++)
+            IMU_UNROLL
+            for (int c = r + 1; c < C; c++)
+                m[r * C + c] = m[c * C + r] = (m[r * C + c] + m[c * C + r]) / 2;
+        return *this;
+    }
+
+    /** Matrix product.
+     */
+    template <int K>
+    Matrix<T, R, K> operator * (const Matrix<T, C, K> & rhs) const
+    {
+        Matrix<T, R, K> res;
+        IMU_UNROLL
+        for (int r = 0; r < R; r++)
+            IMU_UNROLL
+            for (int k = 0; k < K; k++)
+            {
+                T s = 0;
+                IMU_UNROLL
+                for (int c = 0; c < C; c++) s += m[r * C + c] * rhs(c, k);
+                res(r, k) = s;
+            }
+        return res;
+    }
+
+    Matrix<T, R, C> & operator += (const Matrix<T, R, C> & rhs) { IMU_UNROLL for (int i = 0; i < R * C; i++) m[i] += rhs.m[i]; return *this; };
+    Matrix<T, R, C> & operator -= (const Matrix<T, R, C> & rhs) { IMU_UNROLL for (int i = 0; i < R * C; i++) m[i] -= rhs.m[i]; return *this; };
+    Matrix<T, R, C> & operator *= (const T & rhs)               { IMU_UNROLL for (int i = 0; i < R * C; i++) m[i] *= rhs;     return *this; };
+    Matrix<T, R, C> & operator /= (const T & rhs)               { IMU_UNROLL for (int i = 0; i < R * C; i++) m[i] /= rhs;     return *this; };
+
+    Matrix<T, R, C>   operator -  (void) const { Matrix<T, R, C> res = *this; return res *= T(-1); };
+
+    private:
+
+    T m[R * C];
+}; // class Matrix
+
+template <typename T, int R, int C>
+    inline Matrix<T, R, C> operator + (const Matrix<T, R, C> &lhs, const Matrix<T, R, C> &rhs) { Matrix<T, R, C> res = lhs; res += rhs; return res; };
+template <typename T, int R, int C>
+    inline Matrix<T, R, C> operator - (const Matrix<T, R, C> &lhs, const Matrix<T, R, C> &rhs) { Matrix<T, R, C> res = lhs; res -= rhs; return res; };
+template <typename T, int R, int C>
+    inline Matrix<T, R, C> operator * (const Matrix<T, R, C> &lhs, const T &rhs) { Matrix<T, R, C> res = lhs; res *= rhs; return res; };
+template <typename T, int R, int C>
+    inline Matrix<T, R, C> operator * (const T &lhs, const Matrix<T, R, C> &rhs) { Matrix<T, R, C> res = rhs; res *= lhs; return res; };
+
+/** 3x1 column from a Vector3D.
+ */
+template <typename T>
+    inline Matrix<T, 3, 1> column(const Vector3D<T> & v) { const T a[3] = { v.X(), v.Y(), v.Z() }; return Matrix<T, 3, 1>(a); };
+
+/** Vector3D from rows r .. r+2 of a column.
+ */
+template <typename T, int R>
+    inline Vector3D<T> vector3D(const Matrix<T, R, 1> & m, int r = 0) { return Vector3D<T>(m(r, 0), m(r + 1, 0), m(r + 2, 0)); };
+
+/** Cross product matrix: skew(a) * b == a x b.
+ */
+template <typename T>
+    inline Matrix<T, 3, 3> skew(const Vector3D<T> & v)
+{
+    const T a[9] = { 0, -v.Z(), v.Y(), v.Z(), 0, -v.X(), -v.Y(), v.X(), 0 };
+    return Matrix<T, 3, 3>(a);
+}
+
+/**
+ * Solve A X = B for symmetric positive definite A by Cholesky.
+ *
+ * @param a The N x N matrix, only the lower triangle is read.
+ * @param b In: right hand sides.  Out: the solution X.
+ *
+ * @return false (b unchanged) if A is not positive definite.
+ */
+template <typename T, int N, int K>
+inline bool
+solveSPD(const Matrix<T, N, N> & a, Matrix<T, N, K> & b)
+{
+    Matrix<T, N, N> l;
+
+    IMU_UNROLL
+    for (int j = 0; j < N; j++)
+    {
+        T d = a(j, j);
+
+        IMU_UNROLL
+        for (int k = 0; k < j; k++) d -= l(j, k) * l(j, k);
+        if (!(d > 0)) return false;
+        l(j, j) = PreciseMath::sqrt(d);
+        IMU_UNROLL
+        for (int i = j + 1; i < N; i++)
+        {
+            T s = a(i, j);
+
+            IMU_UNROLL
+            for (int k = 0; k < j; k++) s -= l(i, k) * l(j, k);
+            l(i, j) = s / l(j, j);
+        }
+    }
+    IMU_UNROLL
+    for (int c = 0; c < K; c++)
+    {
+        IMU_UNROLL
+        for (int i = 0; i < N; i++)
+        {
+            T s = b(i, c);
+            IMU_UNROLL
+            for (int k = 0; k < i; k++) s -= l(i, k) * b(k, c);
+            b(i, c) = s / l(i, i);
+        }
+        IMU_UNROLL
+        for (int i = N - 1; i >= 0; i--)
+        {
+            T s = b(i, c);
+            IMU_UNROLL
+            for (int k = i + 1; k < N; k++) s -= l(k, i) * b(k, c);
+            b(i, c) = s / l(i, i);
+        }
+    }
+    return true;
+}
+
+}; // namespace IMU
+
+#endif //__MATRIX_H__
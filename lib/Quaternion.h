@@ -1,15 +1,43 @@
 #ifndef __QUATERNION_H__
 #define __QUATERNION_H__
 
+#include <stddef.h>
 #include <math.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <Vector3D.h>
 
 namespace IMU 
 {
 
+/** @class QuaternionTraits
+*
+* Storage options for Quaternion<T>.
+*
+* ALIGN is the alignment of a whole Quaternion<T>.  Quaternion<float> is 16
+* bytes laid out x, y, z, w and is aligned to 16 so it is always a single
+* 128-bit load that never splits a cache line; everything else keeps the
+* alignment of T.  Specialize this to change it for another T.
+*/
+template <typename T>
+struct QuaternionTraits
+{
+    static const size_t ALIGN = alignof(T);
+};
+
+template <>
+struct QuaternionTraits<float>
+{
+    static const size_t ALIGN = 16;
+};
+
 template<typename T>
-class Quaternion : private Vector3D<T>
+class alignas(QuaternionTraits<T>::ALIGN) Quaternion : private Vector3D<T>
 {
     public:
     
@@ -92,7 +120,9 @@ class Quaternion : private Vector3D<T>
 
     // Quaternion Operations
     T                   dot(const Quaternion<T> & v) const  { return w*v.w+this->Vector3D<T>::dot(v); };
-    T                   length(void)                 const  { return sqrt(dot(*this)); };
+    T                   length(void)                 const  { return PreciseMath::sqrt(dot(*this)); };
+    template <class M>
+    T                   length(void)                 const  { return M::sqrt(dot(*this)); };
     Quaternion<T>       conj(void)                   const  { return Quaternion<T>(this->w, -this->x, -this->y, -this->z); };
     Quaternion<T>   &   normalize(void);
     Quaternion<T>       norm(void)                   const;
@@ -130,16 +160,19 @@ class Quaternion : private Vector3D<T>
 
     T w;
 
-    static const T MIN_NORM = 1.0e-7;
+    static const T MIN_NORM;
 
 }; // class Quaternion
 
+template <typename T>
+const T Quaternion<T>::MIN_NORM = T(1.0e-7);
 
 template <typename T>
 Quaternion<T> 
 Quaternion<T>::norm(void) const
 {
     T len = this->length();
+    IMU_TELEMETRY_HOOK(quaternionNorm(len, MIN_NORM));
     if (len > MIN_NORM)
     {
         return Quaternion<T>(this->w / len, this->x / len, this->y / len, this->z / len);
@@ -152,6 +185,7 @@ Quaternion<T> &
 Quaternion<T>::normalize(void)
 {
     T len = this->length();
+    IMU_TELEMETRY_HOOK(quaternionNorm(len, MIN_NORM));
     if (len > MIN_NORM)
     {
         this->w /= len;
@@ -177,9 +211,15 @@ template <typename T>
 Vector3D<T>
 Quaternion<T>::getEulerAngles(void) const
 {
-    T psi   = atan2(2.0f * this->x * this->y - 2.0f * this->w * this->z, 2.0f * this->w * this->w + 2.0f * this->x * this->x - 1);
-    T theta = -asin(2.0f * this->x * this->z + 2.0f * this->w * this->y);
-    T phi   = atan2(2.0f * this->y * this->z - 2.0f * this->w * this->x, 2.0f * this->w * this->w + 2.0f * this->z * this->z - 1);
+    T sinTheta = 2 * this->x * this->z + 2 * this->w * this->y;
+
+    // Rounding can push |sin| just past 1 near +-90 degrees pitch, asin would return NaN.
+    if (sinTheta >  1) sinTheta =  1;
+    if (sinTheta < -1) sinTheta = -1;
+
+    T psi   = atan2(2 * this->x * this->y - 2 * this->w * this->z, 2 * this->w * this->w + 2 * this->x * this->x - 1);
+    T theta = -asin(sinTheta);
+    T phi   = atan2(2 * this->y * this->z - 2 * this->w * this->x, 2 * this->w * this->w + 2 * this->z * this->z - 1);
 
     return Vector3D<T>(phi, theta, psi);
 }
@@ -223,6 +263,213 @@ Quaternion<T>::operator *= (const Quaternion<T> & rhs)
     return *this;
 }
 
+#if defined(__SSE2__) || defined(__ARM_NEON)
+
+/*
+ * Quaternion<float> in one 128-bit register, lanes x, y, z, w.
+ *
+ * These replace the generic members above for float.  Every lane does the
+ * same multiplies and adds in the same order as the scalar code, with no
+ * fused multiply-add, so the results are bit identical to the generic
+ * template.  That holds only while the compiler does not contract the
+ * scalar code into FMAs either: GCC does by default once FMA is enabled
+ * (-march=native), build with -ffp-contract=off where it matters.
+ */
+namespace detail
+{
+
+#if defined(__SSE2__)
+
+typedef __m128 QuatReg;
+
+inline QuatReg quatLoad(const float * p)           { return _mm_loadu_ps(p); };
+inline QuatReg quatPure(const Vector3D<float> & v) { return _mm_set_ps(0, v.Z(), v.Y(), v.X()); };
+inline void    quatStore(float * p, QuatReg v)     { _mm_storeu_ps(p, v); };
+inline float   quatLane0(QuatReg v)                { return _mm_cvtss_f32(v); };
+
+/** w*w' + ((x*x' + y*y') + z*z') in lane 0.
+ */
+inline QuatReg
+quatDot(QuatReg a, QuatReg b)
+{
+    const __m128 d = _mm_mul_ps(a, b);
+    __m128 s = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)));
+
+    s = _mm_add_ss(s, _mm_movehl_ps(d, d));
+    return _mm_add_ss(_mm_shuffle_ps(d, d, _MM_SHUFFLE(3, 3, 3, 3)), s);
+}
+
+inline QuatReg
+quatMul(QuatReg a, QuatReg b)
+{
+    // Lanes x, y, z run the scalar a*b.w + a.w*b + a1*b2 - a2*b1.  Lane 3 runs
+    // the real part's ((x*x' + y*y') + z*z') in the same three products and
+    // gets w*w' - that as (-sum) - (-w*w'), which is the same IEEE result
+    // down to the sign of a zero.
+    const __m128 m  = _mm_castsi128_ps(_mm_set_epi32((int)0x80000000, 0, 0, 0));
+    const __m128 p1 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 2, 1, 0)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 3, 3)));
+    const __m128 p2 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 3, 3, 3)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 0)));
+    const __m128 p3 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 0, 2, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 1, 0, 2)));
+    const __m128 p4 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1)));
+
+    return _mm_sub_ps(_mm_xor_ps(_mm_add_ps(_mm_add_ps(p1, p2), p3), m), _mm_xor_ps(p4, m));
+}
+
+inline QuatReg
+quatConj(QuatReg a)
+{
+    return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set_epi32(0, (int)0x80000000, (int)0x80000000, (int)0x80000000)));
+}
+
+inline QuatReg
+quatDiv(QuatReg a, float len)
+{
+    return _mm_div_ps(a, _mm_set1_ps(len));
+}
+
+inline float
+quatSqrt(QuatReg d)
+{
+    return _mm_cvtss_f32(_mm_sqrt_ss(d));
+}
+
+#else // __ARM_NEON
+
+typedef float32x4_t QuatReg;
+
+inline QuatReg quatLoad(const float * p)           { return vld1q_f32(p); };
+inline QuatReg quatPure(const Vector3D<float> & v) { const float p[4] = { v.X(), v.Y(), v.Z(), 0 }; return vld1q_f32(p); };
+inline void    quatStore(float * p, QuatReg v)     { vst1q_f32(p, v); };
+inline float   quatLane0(QuatReg v)                { return vgetq_lane_f32(v, 0); };
+
+inline QuatReg
+quatDot(QuatReg a, QuatReg b)
+{
+    const float32x4_t d = vmulq_f32(a, b);
+    const float s = (vgetq_lane_f32(d, 0) + vgetq_lane_f32(d, 1)) + vgetq_lane_f32(d, 2);
+
+    return vdupq_n_f32(vgetq_lane_f32(d, 3) + s);
+}
+
+inline QuatReg
+quatMul(QuatReg a, QuatReg b)
+{
+    // NEON has no general lane shuffle on ARMv7; the rotated copies come from the lanes.
+    const float ax = vgetq_lane_f32(a, 0), ay = vgetq_lane_f32(a, 1), az = vgetq_lane_f32(a, 2), aw = vgetq_lane_f32(a, 3);
+    const float bx = vgetq_lane_f32(b, 0), by = vgetq_lane_f32(b, 1), bz = vgetq_lane_f32(b, 2), bw = vgetq_lane_f32(b, 3);
+    const float a1[4] = { ay, az, ax, 0 }, a2[4] = { az, ax, ay, 0 };
+    const float b1[4] = { by, bz, bx, 0 }, b2[4] = { bz, bx, by, 0 };
+
+    float32x4_t v = vaddq_f32(vmulq_f32(a, vdupq_n_f32(bw)), vmulq_f32(vdupq_n_f32(aw), b));
+    v = vsubq_f32(vaddq_f32(v, vmulq_f32(vld1q_f32(a1), vld1q_f32(b2))), vmulq_f32(vld1q_f32(a2), vld1q_f32(b1)));
+
+    const float32x4_t d = vmulq_f32(a, b);
+    const float s = (vgetq_lane_f32(d, 0) + vgetq_lane_f32(d, 1)) + vgetq_lane_f32(d, 2);
+
+    return vsetq_lane_f32(vgetq_lane_f32(d, 3) - s, v, 3);
+}
+
+inline QuatReg
+quatConj(QuatReg a)
+{
+    static const uint32_t sign[4] = { 0x80000000u, 0x80000000u, 0x80000000u, 0 };
+
+    return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vld1q_u32(sign)));
+}
+
+inline QuatReg
+quatDiv(QuatReg a, float len)
+{
+    // ARMv7 NEON has no vector divide, four scalar divides keep it exact.
+    float v[4];
+
+    vst1q_f32(v, a);
+    v[0] /= len, v[1] /= len, v[2] /= len, v[3] /= len;
+    return vld1q_f32(v);
+}
+
+inline float
+quatSqrt(QuatReg d)
+{
+    return sqrtf(vgetq_lane_f32(d, 0));
+}
+
+#endif // __SSE2__ / __ARM_NEON
+
+}; // namespace detail
+
+template <>
+inline Quaternion<float>
+Quaternion<float>::operator * (const Quaternion<float> & rhs) const
+{
+    static_assert(sizeof(Quaternion<float>) == 4 * sizeof(float), "Quaternion<float> must be x, y, z, w");
+
+    Quaternion<float> res;
+
+    detail::quatStore(&res.x, detail::quatMul(detail::quatLoad(&this->x), detail::quatLoad(&rhs.x)));
+    return res;
+}
+
+template <>
+inline Quaternion<float> &
+Quaternion<float>::operator *= (const Quaternion<float> & rhs)
+{
+    detail::quatStore(&this->x, detail::quatMul(detail::quatLoad(&this->x), detail::quatLoad(&rhs.x)));
+    return *this;
+}
+
+template <>
+inline Quaternion<float>
+Quaternion<float>::conj(void) const
+{
+    Quaternion<float> res;
+
+    detail::quatStore(&res.x, detail::quatConj(detail::quatLoad(&this->x)));
+    return res;
+}
+
+template <>
+inline float
+Quaternion<float>::dot(const Quaternion<float> & v) const
+{
+    return detail::quatLane0(detail::quatDot(detail::quatLoad(&this->x), detail::quatLoad(&v.x)));
+}
+
+template <>
+inline Quaternion<float> &
+Quaternion<float>::normalize(void)
+{
+    const detail::QuatReg q = detail::quatLoad(&this->x);
+    const float len = detail::quatSqrt(detail::quatDot(q, q));
+
+    IMU_TELEMETRY_HOOK(quaternionNorm(len, MIN_NORM));
+    if (len > MIN_NORM) detail::quatStore(&this->x, detail::quatDiv(q, len));
+    return *this;
+}
+
+template <>
+inline Vector3D<float>
+Quaternion<float>::rot(const Vector3D<float> & vec) const
+{
+    // Keeps the pure quaternion in a register, a store and reload of it would stall.
+    const detail::QuatReg q = detail::quatLoad(&this->x);
+    float p[4];
+
+    detail::quatStore(p, detail::quatMul(detail::quatMul(q, detail::quatPure(vec)), detail::quatConj(q)));
+    return Vector3D<float>(p[0], p[1], p[2]);
+}
+
+template <>
+inline Quaternion<float>
+Quaternion<float>::norm(void) const
+{
+    Quaternion<float> res(*this);
+
+    return res.normalize();
+}
+
+#endif // __SSE2__ || __ARM_NEON
+
 template <typename T>
 inline Quaternion<T> 
 operator + (const Quaternion<T> &lhs, const Quaternion<T> &rhs) { Quaternion<T> res = lhs; res += rhs; return res; };
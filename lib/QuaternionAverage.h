@@ -0,0 +1,279 @@
+#ifndef __QUATERNION_AVERAGE_H__
+#define __QUATERNION_AVERAGE_H__
+
+#include <stddef.h>
+#include <limits>
+
+#include <Quaternion.h>
+#include <Matrix.h>
+#include <FastMath.h>
+
+namespace IMU
+{
+
+/** @class QuaternionAverage
+*
+* Sliding window mean of up to N attitudes.
+*
+* The mean is Markley's: the eigenvector of the largest eigenvalue of
+* M = sum w q q^T, which is the rotation closest to all samples in the
+* chordal sense and, unlike averaging components, does not care about the
+* sign of each q.  M is kept up to date on push() and pop(), so the cost of
+* mean() does not depend on the window.  It is found by power iteration
+* (with M^4 above float precision) started from the previous mean, which
+* takes a few steps for windows whose samples are within a few tens of
+* degrees of each other.
+* Windows spread over most of the rotation group have no well defined mean
+* and converge slowly; maxIter bounds the cost.
+*
+* Samples are stored sign aligned: push() negates q if its dot() with the
+* previous sample is negative.  The aligned running sum gives linearMean(),
+* a cheaper first order mean, and the power iteration's first guess.
+*
+* Adding and removing the same terms lets rounding accumulate in M and the
+* sum, so both are rebuilt from the stored samples once every N removals,
+* O(1) amortized.  Nothing is allocated; the samples live in the object.
+*/
+template <typename T, size_t N>
+class QuaternionAverage
+{
+    static_assert(N != 0, "QuaternionAverage needs room for a sample");
+
+    public:
+
+    /** Default constructor, empty.
+     */
+    QuaternionAverage(void) { clear(); };
+
+    /** Forget all samples.
+     */
+    void clear(void)
+    {
+        head = 0;
+        n = 0;
+        stale = 0;
+        acc = Matrix<T, 4, 4>();
+        sum = Quaternion<T>(0, 0, 0, 0);
+        sumW = 0;
+        cache = Quaternion<T>();
+        valid = false;
+        seeded = false;
+    }
+
+    static size_t capacity(void) { return N; };
+    size_t        size(void)  const { return n; };
+    bool          empty(void) const { return !n; };
+    bool          full(void)  const { return n == N; };
+
+    /** Sample i, oldest first, as stored (sign aligned).
+     */
+    const Quaternion<T> & operator [] (size_t i) const { return buf[index(i)]; };
+
+    /** Sum of the weights in the window.
+     */
+    T             weight(void) const { return sumW; };
+
+    /**
+     * Add a sample, dropping the oldest one if the window is full.
+     *
+     * @param q      Attitude, unit length.
+     * @param weight Its weight, > 0.
+     */
+    void push(const Quaternion<T> & q, const T & weight = T(1))
+    {
+        if (n == N) pop();
+
+        Quaternion<T> a = q;
+
+        if (n && a.dot(buf[index(n - 1)]) < T(0)) a *= T(-1);
+
+        const size_t i = index(n);
+
+        buf[i] = a;
+        wt[i]  = weight;
+        n++;
+        add(a, weight);
+        valid = false;
+    }
+
+    /**
+     * Drop the oldest sample.
+     *
+     * @return false if the window was empty.
+     */
+    bool pop(void)
+    {
+        if (!n) return false;
+
+        const Quaternion<T> & a = buf[head];
+
+        add(a, -wt[head]);
+        head = (head + 1 == N) ? 0 : head + 1;
+        n--;
+        valid = false;
+
+        if (++stale >= N) rebuild();
+        return true;
+    }
+
+    /**
+     * First order mean: the normalized sum of the aligned samples.  Within
+     * about 1e-3 rad of mean() while the samples stay within 5 degrees of
+     * each other.  Identity for an empty window.
+     */
+    Quaternion<T> linearMean(void) const
+    {
+        const T nn = sum.dot(sum);
+
+        if (!(nn > T(0))) return Quaternion<T>();
+
+        Quaternion<T> res = sum;
+
+        return res *= rsqrt(nn);
+    }
+
+    /**
+     * Mean rotation of the window, in the hemisphere of the samples.
+     * Identity for an empty window.
+     *
+     * @param tolerance Stop iterating once an iteration moves the estimate
+     *                  by less than this (4-vector distance, about half the
+     *                  rotation angle), or no less than the one before.
+     *                  Default 16 eps.
+     * @param maxIter   Iteration limit.
+     */
+    Quaternion<T> mean(const T & tolerance = 16 * std::numeric_limits<T>::epsilon(), int maxIter = 32) const;
+
+    /**
+     * 1 - lambda_max / weight(): 0 when all samples agree, up to 0.75 for
+     * uniformly spread attitudes.  For small spreads it is about the weighted
+     * mean of sin^2(angle / 2) of the samples from the mean.
+     */
+    T spread(void) const
+    {
+        if (!(sumW > T(0))) return T(0);
+
+        const Quaternion<T> q = mean();
+        const T c[4] = { q.W(), q.X(), q.Y(), q.Z() };
+        T l = 0;
+
+        // v^T M v from the upper triangle.
+        IMU_UNROLL
+        for (int r = 0; r < 4; r++)
+        {
+            l += acc(r, r) * c[r] * c[r];
+            IMU_UNROLL
+            for (int k = r + 1; k < 4; k++) l += 2 * acc(r, k) * c[r] * c[k];
+        }
+        return T(1) - l / sumW;
+    }
+
+    private:
+
+    size_t index(size_t i) const { const size_t j = head + i; return (j >= N) ? j - N : j; };
+
+    static Matrix<T, 4, 1> column(const Quaternion<T> & q) { const T a[4] = { q.W(), q.X(), q.Y(), q.Z() }; return Matrix<T, 4, 1>(a); };
+
+    /** acc += w q q^T, sum += w q, for w of either sign.
+     */
+    void add(const Quaternion<T> & q, const T & w)
+    {
+        const T c[4] = { q.W(), q.X(), q.Y(), q.Z() };
+
+        IMU_UNROLL
+        for (int r = 0; r < 4; r++)
+        {
+            const T wr = w * c[r];
+
+            IMU_UNROLL
+            for (int k = r; k < 4; k++) acc(r, k) += wr * c[k];
+        }
+        Quaternion<T> qw = q;
+
+        sum += qw *= w;
+        sumW += w;
+    }
+
+    /** Recompute acc, sum and sumW from the stored samples.
+     */
+    void rebuild(void)
+    {
+        acc = Matrix<T, 4, 4>();
+        sum = Quaternion<T>(0, 0, 0, 0);
+        sumW = 0;
+        for (size_t i = 0; i < n; i++) add(buf[index(i)], wt[index(i)]);
+        stale = 0;
+    }
+
+    Quaternion<T>     buf[N];
+    T                 wt[N];
+    size_t            head;
+    size_t            n;
+    size_t            stale;    // pops since the last rebuild()
+
+    Matrix<T, 4, 4>   acc;      // upper triangle of sum w q q^T
+    Quaternion<T>     sum;      // sum w q
+    T                 sumW;
+
+    mutable Quaternion<T> cache;    // last mean(), the next first guess
+    mutable bool          valid;    // cache is the mean of the current window
+    mutable bool          seeded;   // cache is the mean of some earlier window
+}; // class QuaternionAverage
+
+template <typename T, size_t N>
+Quaternion<T>
+QuaternionAverage<T, N>::mean(const T & tolerance, int maxIter) const
+{
+    if (valid) return cache;
+    if (!n)    return Quaternion<T>();
+
+    // M / weight() from the upper triangle.  Above float precision it is
+    // squared twice, so each step below applies M^4 and the convergence
+    // ratio lambda2 / lambda1 is raised to the fourth power: two products
+    // are cheaper than the extra steps down to double rounding.  The
+    // scaling keeps every entry within [-1, 1].
+    const int       squarings = (std::numeric_limits<T>::digits > 24) ? 2 : 0;
+    const T         inv = T(1) / sumW;
+    Matrix<T, 4, 4> m;
+
+    IMU_UNROLL
+    for (int r = 0; r < 4; r++)
+        IMU_UNROLL
+        for (int k = r; k < 4; k++) m(r, k) = m(k, r) = acc(r, k) * inv;
+    for (int i = 0; i < squarings; i++) m = m * m;
+
+    // Start from the previous mean unless the window has moved far from it.
+    Quaternion<T> v = linearMean();
+
+    if (seeded && cache.dot(v) > T(0.9)) v = cache;
+
+    T last = 4;
+
+    for (int it = 0; it < maxIter; it++)
+    {
+        const Matrix<T, 4, 1> mv = m * column(v);
+        Quaternion<T>         u(mv(0, 0), mv(1, 0), mv(2, 0), mv(3, 0));
+        const T               uu = u.dot(u);
+
+        if (!(uu > T(0))) break;
+
+        u *= rsqrt(uu);
+
+        const Quaternion<T> step = u - v;
+        const T             ss = step.dot(step);
+
+        v = u;
+        // Converged, or stalled at the rounding noise of M v.
+        if (ss <= tolerance * tolerance || (ss >= last && ss <= T(1e6) * tolerance * tolerance)) break;
+        last = ss;
+    }
+    if (v.dot(sum) < T(0)) v *= T(-1);
+
+    cache = v;
+    valid = seeded = true;
+    return v;
+}
+
+}; // namespace IMU
+
+#endif //__QUATERNION_AVERAGE_H__
@@ -0,0 +1,257 @@
+#ifndef __QUATERNION_BATCH_H__
+#define __QUATERNION_BATCH_H__
+
+#include <stddef.h>
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+
+namespace IMU
+{
+
+/**
+ * Batch rotation of many vectors by a single Quaternion.
+ *
+ * Quaternion<T>::rot() does two Hamilton products per vector.  When the same
+ * attitude is applied to a whole buffer it is much cheaper to expand the
+ * sandwich product q * v * q' once into its 3x3 matrix and then do 9
+ * multiplies per vector.  The matrix is built from the full quadratic form,
+ * so the result matches rot() for non-unit quaternions as well (scaled by
+ * |q|^2).
+ *
+ * Buffers are structure-of-arrays (x[], y[], z[]) or arrays of Vector3D<T>.
+ * Input and output may be the same buffers (in place), but must not
+ * otherwise overlap.  float and double use SSE2/AVX(/FMA) kernels when the
+ * compiler targets them, every other T uses the scalar loop.
+ */
+namespace detail
+{
+
+/**
+ * Expand q * v * conj(q) into a row-major 3x3 matrix.
+ *
+ * @param q The rotation.
+ * @param m Output, 9 elements, row-major.
+ */
+template <typename T>
+inline void
+rotMatrix(const Quaternion<T> & q, T * m)
+{
+    const T w = q.W(), x = q.X(), y = q.Y(), z = q.Z();
+    const T ww = w * w, xx = x * x, yy = y * y, zz = z * z;
+    const T xy = x * y, xz = x * z, yz = y * z;
+    const T wx = w * x, wy = w * y, wz = w * z;
+
+    m[0] = ww + xx - yy - zz; m[1] = 2 * (xy - wz);     m[2] = 2 * (xz + wy);
+    m[3] = 2 * (xy + wz);     m[4] = ww - xx + yy - zz; m[5] = 2 * (yz - wx);
+    m[6] = 2 * (xz - wy);     m[7] = 2 * (yz + wx);     m[8] = ww - xx - yy + zz;
+}
+
+/**
+ * Apply a 3x3 matrix to n SoA vectors, scalar version.
+ */
+template <typename T>
+inline void
+rot3x3(const T * m, const T * x, const T * y, const T * z, T * ox, T * oy, T * oz, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        const T vx = x[i], vy = y[i], vz = z[i];
+
+        ox[i] = m[0] * vx + m[1] * vy + m[2] * vz;
+        oy[i] = m[3] * vx + m[4] * vy + m[5] * vz;
+        oz[i] = m[6] * vx + m[7] * vy + m[8] * vz;
+    }
+}
+
+#if defined(__AVX__)
+
+#if defined(__FMA__)
+#define IMU_MADD_PS(a, b, c) _mm256_fmadd_ps(a, b, c)
+#define IMU_MADD_PD(a, b, c) _mm256_fmadd_pd(a, b, c)
+#else
+#define IMU_MADD_PS(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#define IMU_MADD_PD(a, b, c) _mm256_add_pd(_mm256_mul_pd(a, b), c)
+#endif
+
+inline void
+rot3x3(const float * m, const float * x, const float * y, const float * z, float * ox, float * oy, float * oz, size_t n)
+{
+    const __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+    const __m256 m3 = _mm256_set1_ps(m[3]), m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]);
+    const __m256 m6 = _mm256_set1_ps(m[6]), m7 = _mm256_set1_ps(m[7]), m8 = _mm256_set1_ps(m[8]);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 vx = _mm256_loadu_ps(x + i);
+        const __m256 vy = _mm256_loadu_ps(y + i);
+        const __m256 vz = _mm256_loadu_ps(z + i);
+
+        _mm256_storeu_ps(ox + i, IMU_MADD_PS(m2, vz, IMU_MADD_PS(m1, vy, _mm256_mul_ps(m0, vx))));
+        _mm256_storeu_ps(oy + i, IMU_MADD_PS(m5, vz, IMU_MADD_PS(m4, vy, _mm256_mul_ps(m3, vx))));
+        _mm256_storeu_ps(oz + i, IMU_MADD_PS(m8, vz, IMU_MADD_PS(m7, vy, _mm256_mul_ps(m6, vx))));
+    }
+    rot3x3<float>(m, x + i, y + i, z + i, ox + i, oy + i, oz + i, n - i);
+}
+
+inline void
+rot3x3(const double * m, const double * x, const double * y, const double * z, double * ox, double * oy, double * oz, size_t n)
+{
+    const __m256d m0 = _mm256_set1_pd(m[0]), m1 = _mm256_set1_pd(m[1]), m2 = _mm256_set1_pd(m[2]);
+    const __m256d m3 = _mm256_set1_pd(m[3]), m4 = _mm256_set1_pd(m[4]), m5 = _mm256_set1_pd(m[5]);
+    const __m256d m6 = _mm256_set1_pd(m[6]), m7 = _mm256_set1_pd(m[7]), m8 = _mm256_set1_pd(m[8]);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256d vx = _mm256_loadu_pd(x + i);
+        const __m256d vy = _mm256_loadu_pd(y + i);
+        const __m256d vz = _mm256_loadu_pd(z + i);
+
+        _mm256_storeu_pd(ox + i, IMU_MADD_PD(m2, vz, IMU_MADD_PD(m1, vy, _mm256_mul_pd(m0, vx))));
+        _mm256_storeu_pd(oy + i, IMU_MADD_PD(m5, vz, IMU_MADD_PD(m4, vy, _mm256_mul_pd(m3, vx))));
+        _mm256_storeu_pd(oz + i, IMU_MADD_PD(m8, vz, IMU_MADD_PD(m7, vy, _mm256_mul_pd(m6, vx))));
+    }
+    rot3x3<double>(m, x + i, y + i, z + i, ox + i, oy + i, oz + i, n - i);
+}
+
+#undef IMU_MADD_PS
+#undef IMU_MADD_PD
+
+#elif defined(__SSE2__)
+
+inline void
+rot3x3(const float * m, const float * x, const float * y, const float * z, float * ox, float * oy, float * oz, size_t n)
+{
+    const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+    const __m128 m3 = _mm_set1_ps(m[3]), m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]);
+    const __m128 m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]), m8 = _mm_set1_ps(m[8]);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 vx = _mm_loadu_ps(x + i);
+        const __m128 vy = _mm_loadu_ps(y + i);
+        const __m128 vz = _mm_loadu_ps(z + i);
+
+        _mm_storeu_ps(ox + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, vx), _mm_mul_ps(m1, vy)), _mm_mul_ps(m2, vz)));
+        _mm_storeu_ps(oy + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, vx), _mm_mul_ps(m4, vy)), _mm_mul_ps(m5, vz)));
+        _mm_storeu_ps(oz + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m6, vx), _mm_mul_ps(m7, vy)), _mm_mul_ps(m8, vz)));
+    }
+    rot3x3<float>(m, x + i, y + i, z + i, ox + i, oy + i, oz + i, n - i);
+}
+
+inline void
+rot3x3(const double * m, const double * x, const double * y, const double * z, double * ox, double * oy, double * oz, size_t n)
+{
+    const __m128d m0 = _mm_set1_pd(m[0]), m1 = _mm_set1_pd(m[1]), m2 = _mm_set1_pd(m[2]);
+    const __m128d m3 = _mm_set1_pd(m[3]), m4 = _mm_set1_pd(m[4]), m5 = _mm_set1_pd(m[5]);
+    const __m128d m6 = _mm_set1_pd(m[6]), m7 = _mm_set1_pd(m[7]), m8 = _mm_set1_pd(m[8]);
+    size_t i = 0;
+
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128d vx = _mm_loadu_pd(x + i);
+        const __m128d vy = _mm_loadu_pd(y + i);
+        const __m128d vz = _mm_loadu_pd(z + i);
+
+        _mm_storeu_pd(ox + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(m0, vx), _mm_mul_pd(m1, vy)), _mm_mul_pd(m2, vz)));
+        _mm_storeu_pd(oy + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(m3, vx), _mm_mul_pd(m4, vy)), _mm_mul_pd(m5, vz)));
+        _mm_storeu_pd(oz + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(m6, vx), _mm_mul_pd(m7, vy)), _mm_mul_pd(m8, vz)));
+    }
+    rot3x3<double>(m, x + i, y + i, z + i, ox + i, oy + i, oz + i, n - i);
+}
+
+#endif // __AVX__ / __SSE2__
+
+/**
+ * Apply a 3x3 matrix to n packed Vector3D<T>.
+ *
+ * The vectors are de-interleaved a block at a time into stack buffers so
+ * the SoA kernel can run on them, then written back.
+ */
+template <typename T>
+inline void
+rot3x3(const T * m, const Vector3D<T> * in, Vector3D<T> * out, size_t n)
+{
+    static const size_t BLOCK = 128;
+    T x[BLOCK], y[BLOCK], z[BLOCK];
+
+    for (size_t base = 0; base < n; base += BLOCK)
+    {
+        const size_t len = (n - base < BLOCK) ? n - base : BLOCK;
+
+        for (size_t i = 0; i < len; i++)
+        {
+            x[i] = in[base + i].X();
+            y[i] = in[base + i].Y();
+            z[i] = in[base + i].Z();
+        }
+        rot3x3(m, x, y, z, x, y, z, len);
+        for (size_t i = 0; i < len; i++)
+        {
+            out[base + i].set(x[i], y[i], z[i]);
+        }
+    }
+}
+
+}; // namespace detail
+
+/**
+ * Rotate n SoA vectors by q.
+ *
+ * @param q  The rotation applied to every vector.
+ * @param x  Input X components.
+ * @param y  Input Y components.
+ * @param z  Input Z components.
+ * @param ox Output X components (may be x).
+ * @param oy Output Y components (may be y).
+ * @param oz Output Z components (may be z).
+ * @param n  Number of vectors.
+ */
+template <typename T>
+inline void
+rotBatch(const Quaternion<T> & q, const T * x, const T * y, const T * z, T * ox, T * oy, T * oz, size_t n)
+{
+    T m[9];
+
+    detail::rotMatrix(q, m);
+    detail::rot3x3(m, x, y, z, ox, oy, oz, n);
+}
+
+/**
+ * Rotate n SoA vectors by q in place.
+ */
+template <typename T>
+inline void
+rotBatch(const Quaternion<T> & q, T * x, T * y, T * z, size_t n)
+{
+    rotBatch(q, x, y, z, x, y, z, n);
+}
+
+/**
+ * Rotate an array of n Vector3D<T> by q.
+ *
+ * @param q   The rotation applied to every vector.
+ * @param in  Input vectors.
+ * @param out Output vectors (may be in).
+ * @param n   Number of vectors.
+ */
+template <typename T>
+inline void
+rotBatch(const Quaternion<T> & q, const Vector3D<T> * in, Vector3D<T> * out, size_t n)
+{
+    T m[9];
+
+    detail::rotMatrix(q, m);
+    detail::rot3x3(m, in, out, n);
+}
+
+}; // namespace IMU
+
+#endif //__QUATERNION_BATCH_H__
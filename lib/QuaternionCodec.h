@@ -0,0 +1,369 @@
+#ifndef __QUATERNION_CODEC_H__
+#define __QUATERNION_CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <MathPolicy.h>
+#include <Quaternion.h>
+
+namespace IMU
+{
+
+/** @class QuaternionCodec
+*
+* Smallest-three compression of attitudes into BITS bits, 29 <= BITS <= 48.
+*
+* q and -q are the same rotation, so the largest component (by magnitude) is
+* made positive, dropped, and rebuilt from the unit norm on decode.  The
+* other three then lie in [-1/sqrt(2), 1/sqrt(2)] and are quantized to
+* B = (BITS - 2) / 3 bits each, on a grid of 2^B - 1 levels that contains 0
+* (identity and single axis rotations stay exact about the other axes).
+*
+*     BITS   B    bytes   max angle error   rms angle error
+*      29    9      4       9.6e-3 rad        3.1e-3 rad
+*      32   10      4       4.8e-3 rad        1.6e-3 rad
+*      40   12      5       1.2e-3 rad        3.9e-4 rad
+*      48   15      6       1.5e-4 rad        4.9e-5 rad
+*
+* The max column is maxAngleError(), the bound on the rotation angle between
+* the (normalized) input and its decoded value; on 1e6 random rotations the
+* largest error seen is 92% of it.  The rms column is for uniformly
+* distributed rotations.  Rounding adds about 1e-7 rad in float.
+*
+* Code layout, least significant bit first: 2 bits index of the dropped
+* component (0 w, 1 x, 2 y, 3 z), then the remaining components in w, x, y,
+* z order, B bits each, stored offset by 2^(B-1) - 1; unused high bits are
+* 0.  On the wire a code is BYTES bytes, little endian, on every host.
+*
+* encode() normalizes its input first, so any quaternion may be passed
+* (zero decodes as the identity); ties for the largest component go to the
+* first in w, x, y, z order.  decode() rebuilds the dropped component as
+* sqrt(max(0, 1 - a^2 - b^2 - c^2)) and then normalizes as
+* Quaternion<T>::normalize() does, so its result is unit length and has
+* its largest component positive.
+*
+* The batch versions work on arrays of BYTES byte codes.  For float they
+* run 4 quaternions at a time with SSE2 and give bit identical results to
+* the scalar functions (build with -ffp-contract=off if FMA is enabled);
+* other types use the scalar loop.
+*/
+template <int BITS>
+class QuaternionCodec
+{
+    static_assert(BITS >= 29 && BITS <= 48, "QuaternionCodec supports 29 to 48 bit codes");
+
+    public:
+
+    static const int B     = (BITS - 2) / 3;        // bits per stored component
+    static const int BYTES = (BITS + 7) / 8;        // bytes per code on the wire
+    static const int HALF  = (1 << (B - 1)) - 1;    // stored value of 0
+    static const int TOP   = 2 * HALF;              // stored value of 1/sqrt(2)
+
+    /** Bound on the rotation angle error of encode() then decode(), rad.
+     *
+     * Each stored component is off by at most d = 1 / (sqrt(2) TOP), the
+     * three together by e = sqrt(3) d.  The dropped one is at least 1/2, so
+     * rebuilding it from the unit norm adds at most sqrt(3) e + e^2: the
+     * 4-vector moves by 2 e (1 + e) at most and the rotation by twice that.
+     */
+    static double maxAngleError(void)
+    {
+        const double e = 1.7320508075688772 / (1.4142135623730951 * TOP);
+
+        return 4 * e * (1 + e);
+    }
+
+    /** Encode one quaternion.  Returns the code in the low BITS bits.
+     */
+    template <typename T>
+    static uint64_t encode(const Quaternion<T> & q)
+    {
+        const T w = q.W(), x = q.X(), y = q.Y(), z = q.Z();
+        const T aw = PreciseMath::fabs(w), ax = PreciseMath::fabs(x), ay = PreciseMath::fabs(y), az = PreciseMath::fabs(z);
+        const T len = PreciseMath::sqrt(w * w + ((x * x + y * y) + z * z));
+        int     idx = 0;
+        T       big = aw, sign;
+
+        if (ax > big) big = ax, idx = 1;
+        if (ay > big) big = ay, idx = 2;
+        if (az > big) big = az, idx = 3;
+
+        sign = ((idx == 0) ? w : (idx == 1) ? x : (idx == 2) ? y : z);
+
+        // Scale for [-1/sqrt(2), 1/sqrt(2)] -> [0, TOP], times 1 / |q| and the sign of the dropped one.
+        T k = T(HALF * 1.4142135623730951);
+
+        if (len > T(0)) k = k / len;
+        if (sign < T(0)) k = -k;
+
+        const T a = (idx == 0) ? x : w;
+        const T b = (idx <= 1) ? y : x;
+        const T c = (idx == 3) ? y : z;
+
+        return uint64_t(idx) | (uint64_t(quantize(a * k)) << 2) | (uint64_t(quantize(b * k)) << (2 + B)) | (uint64_t(quantize(c * k)) << (2 + 2 * B));
+    }
+
+    /** Decode one code (the low BITS bits of code).
+     */
+    template <typename T>
+    static Quaternion<T> decode(uint64_t code)
+    {
+        const int idx = int(code & 3);
+        const T   a   = dequantize<T>(int((code >> 2) & MASK));
+        const T   b   = dequantize<T>(int((code >> (2 + B)) & MASK));
+        const T   c   = dequantize<T>(int((code >> (2 + 2 * B)) & MASK));
+        const T   r   = T(1) - ((a * a + b * b) + c * c);
+        const T   m   = (r > T(0)) ? PreciseMath::sqrt(r) : T(0);
+        Quaternion<T> q;
+
+        switch (idx)
+        {
+            case 0:  q.set(m, a, b, c); break;
+            case 1:  q.set(a, m, b, c); break;
+            case 2:  q.set(a, b, m, c); break;
+            default: q.set(a, b, c, m); break;
+        }
+        return q.normalize();
+    }
+
+    /** Write a code as BYTES bytes, little endian.
+     */
+    static void put(uint64_t code, uint8_t * p)
+    {
+        for (int k = 0; k < BYTES; k++) p[k] = uint8_t(code >> (8 * k));
+    }
+
+    /** Read a code written by put().
+     */
+    static uint64_t get(const uint8_t * p)
+    {
+        uint64_t code = 0;
+
+        for (int k = 0; k < BYTES; k++) code |= uint64_t(p[k]) << (8 * k);
+        return code;
+    }
+
+    /**
+     * Encode n SoA quaternions to n * BYTES bytes.
+     *
+     * @param w, x, y, z Quaternion components.
+     * @param out        Output codes, BYTES each.
+     * @param n          Number of quaternions.
+     */
+    template <typename T>
+    static void encode(const T * w, const T * x, const T * y, const T * z, uint8_t * out, size_t n)
+    {
+        encodeLoop(w, x, y, z, out, n);
+    }
+
+    /**
+     * Decode n codes to SoA quaternions.
+     */
+    template <typename T>
+    static void decode(const uint8_t * in, T * w, T * x, T * y, T * z, size_t n)
+    {
+        decodeLoop(in, w, x, y, z, n);
+    }
+
+    /**
+     * Encode an array of n Quaternion<T> to n * BYTES bytes.
+     */
+    template <typename T>
+    static void encode(const Quaternion<T> * q, uint8_t * out, size_t n)
+    {
+        T w[BLOCK], x[BLOCK], y[BLOCK], z[BLOCK];
+
+        for (size_t base = 0; base < n; base += BLOCK)
+        {
+            const size_t len = (n - base < BLOCK) ? n - base : BLOCK;
+
+            for (size_t i = 0; i < len; i++)
+            {
+                w[i] = q[base + i].W(), x[i] = q[base + i].X(), y[i] = q[base + i].Y(), z[i] = q[base + i].Z();
+            }
+            encode(w, x, y, z, out + base * BYTES, len);
+        }
+    }
+
+    /**
+     * Decode n codes to an array of Quaternion<T>.
+     */
+    template <typename T>
+    static void decode(const uint8_t * in, Quaternion<T> * q, size_t n)
+    {
+        T w[BLOCK], x[BLOCK], y[BLOCK], z[BLOCK];
+
+        for (size_t base = 0; base < n; base += BLOCK)
+        {
+            const size_t len = (n - base < BLOCK) ? n - base : BLOCK;
+
+            decode(in + base * BYTES, w, x, y, z, len);
+            for (size_t i = 0; i < len; i++)
+            {
+                q[base + i].set(w[i], x[i], y[i], z[i]);
+            }
+        }
+    }
+
+    private:
+
+    static const uint64_t MASK  = (uint64_t(1) << B) - 1;
+    static const size_t   BLOCK = 128;
+
+    /** Round v in units of the grid, offset to [0, TOP], clamped. */
+    template <typename T>
+    static int quantize(const T & v)
+    {
+        T s = v + T(HALF);
+
+        if (s < T(0))   s = T(0);
+        if (s > T(TOP)) s = T(TOP);
+        return int(s + T(0.5));
+    }
+
+    template <typename T>
+    static T dequantize(int s)
+    {
+        return T(s - HALF) * T(1 / (HALF * 1.4142135623730951));
+    }
+
+    template <typename T>
+    static void encodeLoop(const T * w, const T * x, const T * y, const T * z, uint8_t * out, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) put(encode(Quaternion<T>(w[i], x[i], y[i], z[i])), out + i * BYTES);
+    }
+
+    template <typename T>
+    static void decodeLoop(const uint8_t * in, T * w, T * x, T * y, T * z, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            const Quaternion<T> q = decode<T>(get(in + i * BYTES));
+
+            w[i] = q.W(), x[i] = q.X(), y[i] = q.Y(), z[i] = q.Z();
+        }
+    }
+
+#if defined(__SSE2__)
+
+    static __m128 select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+
+    static __m128i quantize(__m128 v)
+    {
+        __m128 s = _mm_add_ps(v, _mm_set1_ps(float(HALF)));
+
+        s = _mm_min_ps(_mm_max_ps(s, _mm_setzero_ps()), _mm_set1_ps(float(TOP)));
+        return _mm_cvttps_epi32(_mm_add_ps(s, _mm_set1_ps(0.5f)));
+    }
+
+    /** Float SoA encode, 4 per iteration, scalar tail.  Same operations as encode(). */
+    static void encodeLoop(const float * w, const float * x, const float * y, const float * z, uint8_t * out, size_t n)
+    {
+        const __m128 abs  = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 ones = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        size_t       i = 0;
+
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128 qw = _mm_loadu_ps(w + i), qx = _mm_loadu_ps(x + i), qy = _mm_loadu_ps(y + i), qz = _mm_loadu_ps(z + i);
+            const __m128 aw = _mm_and_ps(qw, abs), ax = _mm_and_ps(qx, abs), ay = _mm_and_ps(qy, abs), az = _mm_and_ps(qz, abs);
+            const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(qw, qw), _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_mul_ps(qz, qz))));
+
+            // First largest wins, as in the scalar code.
+            const __m128 g1 = _mm_cmpgt_ps(ax, aw);
+            __m128       big = select(g1, ax, aw);
+            const __m128 g2 = _mm_cmpgt_ps(ay, big);
+
+            big = select(g2, ay, big);
+
+            const __m128 g3 = _mm_cmpgt_ps(az, big);
+            const __m128 i1 = _mm_andnot_ps(g3, _mm_andnot_ps(g2, g1));     // idx == 1
+            const __m128 i2 = _mm_andnot_ps(g3, g2);                        // idx == 2
+            const __m128 i0 = _mm_andnot_ps(_mm_or_ps(g3, _mm_or_ps(g2, g1)), ones);     // idx == 0
+            const __m128 sign = select(g3, qz, select(i2, qy, select(i1, qx, qw)));
+
+            __m128 k = _mm_set1_ps(float(HALF * 1.4142135623730951));
+
+            k = select(_mm_cmpgt_ps(len, _mm_setzero_ps()), _mm_div_ps(k, len), k);
+            k = _mm_xor_ps(k, _mm_and_ps(sign, _mm_set1_ps(-0.0f)));
+
+            const __m128 a = select(i0, qx, qw);
+            const __m128 b = select(_mm_or_ps(g2, g3), qx, qy);
+            const __m128 c = select(g3, qy, qz);
+
+            // idx = 1 * i1 + 2 * i2 + 3 * g3 as masks of all ones (-1).
+            const __m128i idx = _mm_sub_epi32(_mm_setzero_si128(),
+                                              _mm_add_epi32(_mm_add_epi32(_mm_castps_si128(i1), _mm_slli_epi32(_mm_castps_si128(i2), 1)),
+                                                            _mm_add_epi32(_mm_castps_si128(g3), _mm_slli_epi32(_mm_castps_si128(g3), 1))));
+            const __m128i lo  = _mm_or_si128(_mm_or_si128(idx, _mm_slli_epi32(quantize(_mm_mul_ps(a, k)), 2)),
+                                             _mm_slli_epi32(quantize(_mm_mul_ps(b, k)), 2 + B));
+            alignas(16) uint32_t l[4], h[4];
+
+            _mm_store_si128((__m128i *)l, lo);
+            _mm_store_si128((__m128i *)h, quantize(_mm_mul_ps(c, k)));
+            for (int j = 0; j < 4; j++) put(uint64_t(l[j]) | (uint64_t(h[j]) << (2 + 2 * B)), out + (i + j) * BYTES);
+        }
+        encodeLoop<float>(w + i, x + i, y + i, z + i, out + i * BYTES, n - i);
+    }
+
+    /** Float SoA decode, 4 per iteration, scalar tail.  Same operations as decode(). */
+    static void decodeLoop(const uint8_t * in, float * w, float * x, float * y, float * z, size_t n)
+    {
+        const __m128  step = _mm_set1_ps(float(1 / (HALF * 1.4142135623730951)));
+        const __m128i half = _mm_set1_epi32(HALF);
+        size_t        i = 0;
+
+        for (; i + 4 <= n; i += 4)
+        {
+            alignas(16) int32_t f[4][4];
+
+            for (int j = 0; j < 4; j++)
+            {
+                const uint64_t code = get(in + (i + j) * BYTES);
+
+                f[0][j] = int32_t(code & 3);
+                f[1][j] = int32_t((code >> 2) & MASK);
+                f[2][j] = int32_t((code >> (2 + B)) & MASK);
+                f[3][j] = int32_t((code >> (2 + 2 * B)) & MASK);
+            }
+
+            const __m128i idx = _mm_load_si128((const __m128i *)f[0]);
+            const __m128  a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_load_si128((const __m128i *)f[1]), half)), step);
+            const __m128  b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_load_si128((const __m128i *)f[2]), half)), step);
+            const __m128  c = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_load_si128((const __m128i *)f[3]), half)), step);
+            const __m128  r = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), _mm_mul_ps(c, c)));
+            const __m128  m = _mm_and_ps(_mm_cmpgt_ps(r, _mm_setzero_ps()), _mm_sqrt_ps(_mm_max_ps(r, _mm_setzero_ps())));
+            const __m128  e0 = _mm_castsi128_ps(_mm_cmpeq_epi32(idx, _mm_setzero_si128()));
+            const __m128  e1 = _mm_castsi128_ps(_mm_cmpeq_epi32(idx, _mm_set1_epi32(1)));
+            const __m128  e3 = _mm_castsi128_ps(_mm_cmpeq_epi32(idx, _mm_set1_epi32(3)));
+            const __m128  lt2 = _mm_or_ps(e0, e1);
+
+            const __m128  qw = select(e0, m, a);
+            const __m128  qx = select(e0, a, select(e1, m, b));
+            const __m128  qy = select(lt2, b, select(e3, c, m));
+            const __m128  qz = select(e3, m, c);
+
+            // As Quaternion<float>::normalize(): w*w + ((x*x + y*y) + z*z).
+            // The length is about 1 (at least 1 if m was clamped), always
+            // above MIN_NORM.
+            const __m128  len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(qw, qw), _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_mul_ps(qz, qz))));
+
+            _mm_storeu_ps(w + i, _mm_div_ps(qw, len));
+            _mm_storeu_ps(x + i, _mm_div_ps(qx, len));
+            _mm_storeu_ps(y + i, _mm_div_ps(qy, len));
+            _mm_storeu_ps(z + i, _mm_div_ps(qz, len));
+        }
+        decodeLoop<float>(in + i * BYTES, w + i, x + i, y + i, z + i, n - i);
+    }
+
+#endif // __SSE2__
+}; // class QuaternionCodec
+
+}; // namespace IMU
+
+#endif //__QUATERNION_CODEC_H__
@@ -0,0 +1,291 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Quaternion.h>
+#include <ImuSample.h>
+#include <ImuLog.h>
+
+namespace IMU
+{
+
+namespace detail
+{
+
+/** @class StealDeque
+*
+* Per-worker task deque: the owner pushes and pops at the back, thieves take
+* from the front.  Tasks are log indices.  A short mutex per deque is enough
+* here, tasks are whole log chunks, and owners never touch each other's lock
+* unless stealing.  Capacity is fixed at start, nothing is allocated later.
+* Padded to keep neighbouring deques off each other's cache line.
+*/
+class StealDeque
+{
+    public:
+
+    StealDeque(void) : head(0), count(0) {};
+
+    void reserve(size_t n) { buf.assign(n ? n : 1, 0); head = count = 0; };
+
+    void push(uint32_t v)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        buf[(head + count++) % buf.size()] = v;
+    }
+
+    bool pop(uint32_t & v)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (!count) return false;
+        v = buf[(head + --count) % buf.size()];
+        return true;
+    }
+
+    bool steal(uint32_t & v)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (!count) return false;
+        v = buf[head];
+        head = (head + 1) % buf.size();
+        count--;
+        return true;
+    }
+
+    private:
+
+    std::mutex            m;
+    std::vector<uint32_t> buf;
+    size_t                head;
+    size_t                count;
+    char                  pad[64];
+}; // class StealDeque
+
+}; // namespace detail
+
+/** @class ReplayRunner
+*
+* Replays many logs through a sequential job on a work-stealing pool.
+*
+* Each log is processed chunk by chunk, in order, with its own State; a log
+* is one task at a time, re-queued on its worker after every chunk, so an
+* idle worker can steal it (or any queued log) between chunks.  Logs start
+* longest first.  Because a log's chunks always run in order against its own
+* State, results do not depend on the thread count or on scheduling, and
+* reading the States in log order aggregates them deterministically.
+*
+* Job provides:
+*
+*     typedef ... State;      // per log, owned by the caller
+*     typedef ... Scratch;    // per worker, default constructible
+*     size_t chunks(size_t log) const;
+*     void   begin(size_t log, State &, Scratch &) const;
+*     void   run  (size_t log, size_t chunk, State &, Scratch &) const;
+*     void   end  (size_t log, State &, Scratch &) const;
+*
+* The job's methods are called concurrently for different logs.  The calling
+* thread is worker 0.
+*/
+template <class Job>
+class ReplayRunner
+{
+    public:
+
+    typedef typename Job::State   State;
+    typedef typename Job::Scratch Scratch;
+
+    /**
+     * @param threads Worker count, 0 for one per hardware thread.
+     */
+    explicit ReplayRunner(unsigned threads = 0) : nthreads(threads ? threads : std::thread::hardware_concurrency()), stolen(0)
+    {
+        if (!nthreads) nthreads = 1;
+    };
+
+    unsigned threads(void) const { return nthreads; };
+
+    /** Chunks taken from another worker's deque during the last run().
+     */
+    uint64_t steals(void) const { return stolen; };
+
+    /**
+     * Replay logs 0 .. logs-1.
+     *
+     * @param job    The job.
+     * @param logs   Number of logs.
+     * @param states logs States, initialised by the caller, filled in by the job.
+     */
+    void run(const Job & job, size_t logs, State * states)
+    {
+        std::vector<detail::StealDeque> deques(nthreads);
+        std::vector<uint32_t> order(logs);
+        std::vector<size_t> next(logs, 0), total(logs);
+        std::vector<std::thread> pool;
+        std::atomic<size_t> remaining(logs);
+        std::atomic<uint64_t> steals(0);
+
+        for (size_t i = 0; i < logs; i++)
+        {
+            order[i] = (uint32_t)i;
+            total[i] = job.chunks(i);
+        }
+        std::stable_sort(order.begin(), order.end(), Longer(total));
+
+        // Deal longest first round robin; pushed in reverse so owners pop them in that order.
+        for (unsigned w = 0; w < nthreads; w++) deques[w].reserve(logs);
+        for (size_t i = logs; i-- > 0; ) deques[i % nthreads].push(order[i]);
+
+        Shared sh = { &job, states, &deques[0], &next[0], &total[0], &remaining, &steals, nthreads };
+
+        for (unsigned w = 1; w < nthreads; w++) pool.push_back(std::thread(worker, &sh, w));
+        worker(&sh, 0);
+        for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+
+        stolen = steals.load();
+    }
+
+    private:
+
+    struct Shared
+    {
+        const Job                * job;
+        State                    * states;
+        detail::StealDeque       * deques;
+        size_t                   * next;
+        const size_t             * total;
+        std::atomic<size_t>      * remaining;
+        std::atomic<uint64_t>    * steals;
+        unsigned                   nthreads;
+    };
+
+    static void worker(Shared * sh, unsigned self)
+    {
+        Scratch scratch;
+        uint32_t rng = 2463534242u + self * 0x9e3779b9u;
+        uint32_t log;
+
+        while (sh->remaining->load(std::memory_order_acquire))
+        {
+            if (!sh->deques[self].pop(log) && !steal(sh, self, rng, log))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            State & st = sh->states[log];
+            const size_t c = sh->next[log]++;
+
+            if (c == 0) sh->job->begin(log, st, scratch);
+            if (c < sh->total[log]) sh->job->run(log, c, st, scratch);
+            if (c + 1 >= sh->total[log])
+            {
+                sh->job->end(log, st, scratch);
+                sh->remaining->fetch_sub(1, std::memory_order_release);
+            }
+            else
+            {
+                sh->deques[self].push(log);
+            }
+        }
+    }
+
+    static bool steal(Shared * sh, unsigned self, uint32_t & rng, uint32_t & log)
+    {
+        const unsigned n = sh->nthreads;
+
+        if (n == 1) return false;
+
+        // xorshift32 for the first victim, then walk all of them once.
+        rng ^= rng << 13, rng ^= rng >> 17, rng ^= rng << 5;
+        for (unsigned k = 0, v = rng % n; k < n; k++, v = (v + 1) % n)
+        {
+            if (v != self && sh->deques[v].steal(log))
+            {
+                sh->steals->fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct Longer
+    {
+        explicit Longer(const std::vector<size_t> & total) : total(total) {};
+        bool operator () (uint32_t a, uint32_t b) const { return total[a] > total[b]; };
+        const std::vector<size_t> & total;
+    };
+
+    unsigned nthreads;
+    uint64_t stolen;
+}; // class ReplayRunner
+
+/** @class AttitudeReplay
+*
+* ReplayRunner job running an attitude filter (MadgwickAHRS, MahonyAHRS, ...)
+* over the gyro/accel/mag columns of mapped ImuLogs.
+*
+* Every log starts from a copy of the prototype filter.  A chunk's columns
+* are gathered into the worker's sample buffer and fed to the filter's batch
+* update, so the only allocation is each worker growing its buffer once.
+*/
+template <typename T, class F>
+class AttitudeReplay
+{
+    public:
+
+    struct State
+    {
+        explicit State(const F & filter) : filter(filter), samples(0), firstStamp(0), lastStamp(0) {};
+
+        F             filter;
+        uint64_t      samples;
+        uint64_t      firstStamp;
+        uint64_t      lastStamp;
+        Quaternion<T> attitude;     // final attitude, set at the end of the log
+    };
+
+    struct Scratch
+    {
+        std::vector<ImuSample<T> > samples;
+    };
+
+    /**
+     * @param logs  Mapped logs, kept open for the duration of the run.
+     */
+    explicit AttitudeReplay(const ImuLogReader<T> * const * logs) : logs(logs) {};
+
+    size_t chunks(size_t log) const { return logs[log]->chunks(); };
+
+    void begin(size_t, State & st, Scratch &) const { st.samples = 0; };
+
+    void run(size_t log, size_t chunk, State & st, Scratch & scratch) const
+    {
+        const ImuLogChunk<T> ch = logs[log]->chunk(chunk);
+        const size_t n = ch.size();
+
+        if (scratch.samples.size() < n) scratch.samples.resize(n);
+        for (size_t i = 0; i < n; i++) scratch.samples[i] = ch.sample(i);
+        st.filter.update(&scratch.samples[0], n);
+
+        if (!st.samples) st.firstStamp = ch.stamp()[0];
+        st.lastStamp = ch.stamp()[n - 1];
+        st.samples += n;
+    }
+
+    void end(size_t, State & st, Scratch &) const { st.attitude = st.filter.attitude(); };
+
+    private:
+
+    const ImuLogReader<T> * const * logs;
+}; // class AttitudeReplay
+
+}; // namespace IMU
+
+#endif //__REPLAY_H__
@@ -0,0 +1,300 @@
+#ifndef __REVERSE_H__
+#define __REVERSE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <MathPolicy.h>
+
+namespace IMU
+{
+
+template <typename T, class M> class Var;
+
+/** @class Tape
+*
+* Operation record for reverse mode derivatives (see Var).
+*
+* Every operation on a Var appends one node: the indices of its (up to two)
+* operands and the partial derivatives with respect to them.  gradient()
+* then walks the nodes backwards once and leaves d(output)/d(node) in every
+* node, so a gradient with respect to any number of inputs costs a few times
+* the function itself.
+*
+* Node 0 is a dummy that unused operands point at, so the zero partials
+* they carry never reach a real variable: 0 * inf would turn its adjoint
+* into NaN.
+*
+* Nodes live in fixed size blocks that are never moved or freed before the
+* tape is destroyed, the adjoints in one array that grows with them.
+* reset() only rewinds the fill index, so once the tape has grown to the
+* size of one iteration, later iterations allocate nothing.
+*
+* A tape is used by one thread at a time.
+*/
+template <typename T>
+class Tape
+{
+    public:
+
+    static const size_t BLOCK_SHIFT = 12;
+    static const size_t BLOCK       = size_t(1) << BLOCK_SHIFT;  // nodes per block
+
+    /**
+     * Constructor.
+     *
+     * @param reserve Nodes to allocate up front.
+     */
+    explicit Tape(size_t reserve = 0) : n(0), cap(0), swept(0)
+    {
+        while (cap < reserve + 1) grow();
+        push(0, 0, 0, 0);
+    }
+
+    ~Tape(void)
+    {
+        for (size_t b = 0; b < blocks.size(); b++) delete [] blocks[b];
+    }
+
+    Tape(const Tape<T> &) = delete;
+    Tape<T> & operator = (const Tape<T> &) = delete;
+
+    /** Forget all nodes, keep the memory.  Vars recorded before are invalid afterwards.
+     */
+    void reset(void) { n = 1; swept = 0; };
+
+    /** Nodes recorded. */
+    size_t size(void)     const { return n - 1; };
+
+    /** Nodes that fit without allocating. */
+    size_t capacity(void) const { return cap - 1; };
+
+    /**
+     * Backward sweep from y: afterwards adjoint(x) is dy/dx for every Var x
+     * recorded before y.  May be called again for another output.
+     */
+    template <class M>
+    void gradient(const Var<T, M> & y);
+
+    /**
+     * Backward sweep from y, then copy dy/dx[i] to g[i].
+     */
+    template <class M>
+    void gradient(const Var<T, M> & y, const Var<T, M> * x, T * g, size_t count)
+    {
+        gradient(y);
+        for (size_t i = 0; i < count; i++) g[i] = adjoint(x[i]);
+    }
+
+    /**
+     * d(output)/dx from the last gradient() sweep; 0 for constants and for
+     * Vars recorded after the output.
+     */
+    template <class M>
+    T adjoint(const Var<T, M> & x) const
+    {
+        return (x.tape == this && x.idx <= swept) ? adj[x.idx] : T(0);
+    }
+
+    private:
+
+    template <typename U, class P> friend class Var;
+
+    struct Node
+    {
+        T        da, db;    // partials with respect to the operands
+        uint32_t a, b;      // operand indices
+    };
+
+    Node       & node(size_t i)       { return blocks[i >> BLOCK_SHIFT][i & (BLOCK - 1)]; };
+    const Node & node(size_t i) const { return blocks[i >> BLOCK_SHIFT][i & (BLOCK - 1)]; };
+
+    // Out of line so push() stays small enough to inline everywhere.
+    __attribute__((__noinline__)) void grow(void)
+    {
+        blocks.push_back(new Node[BLOCK]);
+        cap += BLOCK;
+        adj.resize(cap);
+    }
+
+    /** Append a node, return its index.  Unused operands point at the dummy node 0 with a zero partial.
+     */
+    uint32_t push(const T & da, uint32_t a, const T & db, uint32_t b)
+    {
+        if (n == cap) grow();
+
+        Node & nd = node(n);
+
+        nd.da = da, nd.db = db;
+        nd.a  = a,  nd.b  = b;
+        return uint32_t(n++);
+    }
+
+    std::vector<Node *> blocks;
+    std::vector<T>      adj;    // d(output) / d(node)
+    size_t              n;
+    size_t              cap;
+    size_t              swept;
+}; // class Tape
+
+template <typename T>
+template <class M>
+void
+Tape<T>::gradient(const Var<T, M> & y)
+{
+    if (y.tape != this) return;
+
+    T * const a = &adj[0];
+
+    swept = y.idx;
+    for (size_t i = 0; i < swept; i++) a[i] = 0;
+    a[swept] = 1;
+
+    // Block by block, so the inner loop walks a plain array.
+    for (size_t b = (swept >> BLOCK_SHIFT) + 1; b-- > 0; )
+    {
+        const Node * const nodes = blocks[b];
+        const size_t       base  = b << BLOCK_SHIFT;
+
+        for (size_t j = (b == (swept >> BLOCK_SHIFT)) ? (swept & (BLOCK - 1)) + 1 : BLOCK; j-- > 0; )
+        {
+            const Node & nd = nodes[j];
+            const T      g  = a[base + j];
+
+            a[nd.a] += nd.da * g;
+            a[nd.b] += nd.db * g;
+        }
+    }
+}
+
+/** @class Var
+*
+* Reverse mode counterpart of Dual: a value recorded on a Tape.
+*
+* Var(tape, x) makes an independent variable.  A plain T converts to a
+* constant Var that is not recorded, and operations between constants are
+* not recorded either, so only the part of a computation that depends on
+* the variables costs tape space.  Var works as the T of Vector3D and
+* Quaternion; all Vars of one computation must use the same tape.
+*
+* Comparisons look at the value only, as they do for Dual.
+*
+* M is the math policy (see MathPolicy.h) used by the transcendental
+* functions.
+*/
+template <typename T, class M = PreciseMath>
+class Var
+{
+    public:
+
+    /** Constant 0.
+     */
+    Var(void) : val(0), idx(0), tape(0) {};
+
+    /** Constant.
+     */
+    Var(T value) : val(value), idx(0), tape(0) {};
+
+    /** Independent variable on tape.
+     */
+    Var(Tape<T> & t, T value) : val(value), idx(t.push(0, 0, 0, 0)), tape(&t) {};
+
+    // Attribute readers...
+    T         value(void)    const { return val; };
+    bool      constant(void) const { return !tape; };
+
+    /** dy/d(this) after tape.gradient(y).
+     */
+    T         adjoint(void)  const { return tape ? tape->adjoint(*this) : T(0); };
+
+    // Arithmetic Operators
+    Var<T, M>   operator +(void) const { return *this; };
+    Var<T, M>   operator -(void) const { return unary(-val, *this, T(-1)); };
+
+    Var<T, M> & operator +=(const Var<T, M> & rhs) { return *this = *this + rhs; };
+    Var<T, M> & operator -=(const Var<T, M> & rhs) { return *this = *this - rhs; };
+    Var<T, M> & operator *=(const Var<T, M> & rhs) { return *this = *this * rhs; };
+    Var<T, M> & operator /=(const Var<T, M> & rhs) { return *this = *this / rhs; };
+
+    // Binary operators.  Friends so a plain T converts on either side.
+    friend Var<T, M> operator +(const Var<T, M> & lhs, const Var<T, M> & rhs) { return binary(lhs.val + rhs.val, lhs, T(1), rhs, T(1)); };
+    friend Var<T, M> operator -(const Var<T, M> & lhs, const Var<T, M> & rhs) { return binary(lhs.val - rhs.val, lhs, T(1), rhs, T(-1)); };
+    friend Var<T, M> operator *(const Var<T, M> & lhs, const Var<T, M> & rhs) { return binary(lhs.val * rhs.val, lhs, rhs.val, rhs, lhs.val); };
+    friend Var<T, M> operator /(const Var<T, M> & lhs, const Var<T, M> & rhs)
+    {
+        const T inv = 1 / rhs.val, r = lhs.val * inv;
+
+        return binary(r, lhs, inv, rhs, -r * inv);
+    };
+
+    friend bool    operator ==(const Var<T, M> & lhs, const Var<T, M> & rhs) { return lhs.val == rhs.val; };
+    friend bool    operator !=(const Var<T, M> & lhs, const Var<T, M> & rhs) { return lhs.val != rhs.val; };
+    friend bool    operator < (const Var<T, M> & lhs, const Var<T, M> & rhs) { return lhs.val <  rhs.val; };
+    friend bool    operator <=(const Var<T, M> & lhs, const Var<T, M> & rhs) { return lhs.val <= rhs.val; };
+    friend bool    operator > (const Var<T, M> & lhs, const Var<T, M> & rhs) { return lhs.val >  rhs.val; };
+    friend bool    operator >=(const Var<T, M> & lhs, const Var<T, M> & rhs) { return lhs.val >= rhs.val; };
+
+    // math.h stuff, as free functions so Var<T, M> can be the T of Vector3D<T> and Quaternion<T>.
+    friend Var<T, M> exp  (const Var<T, M> & x) { const T e = M::exp(x.val); return unary(e, x, e); };
+    friend Var<T, M> log  (const Var<T, M> & x) { return unary(M::log(x.val), x, 1 / x.val); };
+    friend Var<T, M> log10(const Var<T, M> & x) { const T l = M::log(T(10)); return unary(M::log(x.val) / l, x, 1 / (x.val * l)); };
+    friend Var<T, M> sqrt (const Var<T, M> & x) { const T r = M::sqrt(x.val); return unary(r, x, 1 / (2 * r)); };
+    friend Var<T, M> sin  (const Var<T, M> & x) { return unary(M::sin(x.val), x,  M::cos(x.val)); };
+    friend Var<T, M> cos  (const Var<T, M> & x) { return unary(M::cos(x.val), x, -M::sin(x.val)); };
+    friend Var<T, M> tan  (const Var<T, M> & x) { const T t = M::tan(x.val); return unary(t, x, 1 + t * t); };
+    friend Var<T, M> fabs (const Var<T, M> & x) { return (x.val < 0) ? -x : x; };
+    friend Var<T, M> asin (const Var<T, M> & x) { return unary(M::asin(x.val), x, M::rsqrt(1 - x.val * x.val)); };
+    friend Var<T, M> atan2(const Var<T, M> & y, const Var<T, M> & x)
+    {
+        const T den = x.val * x.val + y.val * y.val;
+
+        return binary(M::atan2(y.val, x.val), y, x.val / den, x, -y.val / den);
+    };
+    friend Var<T, M> pow  (const Var<T, M> & x, const T & y)
+    {
+        return unary(M::pow(x.val, y), x, y * M::pow(clamp(x.val), y - 1));
+    };
+    friend Var<T, M> pow  (const Var<T, M> & x, const Var<T, M> & y)
+    {
+        const T r = M::pow(x.val, y.val), c = clamp(x.val);
+
+        return binary(r, x, y.val * M::pow(c, y.val - 1), y, M::pow(c, y.val) * M::log(c));
+    };
+
+    private:
+
+    friend class Tape<T>;
+
+    Var(T value, uint32_t i, Tape<T> * t) : val(value), idx(i), tape(t) {};
+
+    /** |x| kept above 1e-15 for both pow() partials, as Dual does. */
+    static T clamp(const T & x)
+    {
+        static const T min_real = 1e-15;
+
+        if (M::fabs(x) >= min_real) return x;
+        return (x >= 0) ? min_real : -min_real;
+    }
+
+    static Var<T, M> unary(const T & r, const Var<T, M> & a, const T & da)
+    {
+        if (!a.tape) return Var<T, M>(r);
+        return Var<T, M>(r, a.tape->push(da, a.idx, 0, 0), a.tape);
+    }
+
+    static Var<T, M> binary(const T & r, const Var<T, M> & a, const T & da, const Var<T, M> & b, const T & db)
+    {
+        if (!a.tape) return unary(r, b, db);
+        if (!b.tape) return unary(r, a, da);
+        return Var<T, M>(r, a.tape->push(da, a.idx, db, b.idx), a.tape);
+    }
+
+    T          val;
+    uint32_t   idx;
+    Tape<T>  * tape;
+}; // class Var
+
+}; // namespace IMU
+
+#endif //__REVERSE_H__
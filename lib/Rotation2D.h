@@ -0,0 +1,248 @@
+#ifndef __ROTATION2D_H__
+#define __ROTATION2D_H__
+
+#include <stddef.h>
+
+#include <Vector2D.h>
+#include <FastMath.h>
+#include <MathPolicy.h>
+
+namespace IMU
+{
+
+/** @class Rotation2D
+*
+* A planar rotation stored as the unit complex number c + i s, c = cos(angle)
+* and s = sin(angle), counterclockwise positive.
+*
+* Composition is a complex product (4 multiplies), applying it to a vector
+* is 4 multiplies, the inverse is the conjugate.  Nothing here calls a trig
+* function except the angle constructor and angle().
+*/
+template <typename T>
+class Rotation2D
+{
+    public:
+
+    /** Identity.
+     */
+    Rotation2D(void) : c(1), s(0) {};
+
+    /** Rotation by angle, rad.
+     */
+    explicit Rotation2D(const T & angle) : c(PreciseMath::cos(angle)), s(PreciseMath::sin(angle)) {};
+
+    /** From cos and sin, taken as given: the caller keeps c^2 + s^2 = 1.
+     */
+    Rotation2D(const T & c, const T & s) : c(c), s(s) {};
+
+    /** The rotation that turns (1, 0) towards v, v need not be unit length (nor zero).
+     */
+    static Rotation2D<T> fromDirection(const Vector2D<T> & v) { return Rotation2D<T>(v.X(), v.Y()).normalize(); };
+
+    // Attribute readers...
+    T C(void) const { return c; };
+    T S(void) const { return s; };
+
+    /** Angle in (-pi, pi], rad.
+     */
+    T angle(void) const { return PreciseMath::atan2(s, c); };
+
+    Rotation2D<T> conj(void)    const { return Rotation2D<T>(c, -s); };
+    Rotation2D<T> inverse(void) const { return conj(); };
+
+    /** Rotate v.
+     */
+    Vector2D<T> rot(const Vector2D<T> & v) const { return Vector2D<T>(c * v.X() - s * v.Y(), s * v.X() + c * v.Y()); };
+
+    /** Rotate v by the inverse.
+     */
+    Vector2D<T> unrot(const Vector2D<T> & v) const { return Vector2D<T>(c * v.X() + s * v.Y(), c * v.Y() - s * v.X()); };
+
+    /** Exact normalization.
+     */
+    Rotation2D<T> & normalize(void)
+    {
+        const T n2 = c * c + s * s;
+
+        if (n2 > T(0))
+        {
+            const T inv = rsqrt(n2);
+
+            c *= inv, s *= inv;
+        }
+        else
+        {
+            c = 1, s = 0;
+        }
+        return *this;
+    }
+
+    /**
+     * First order renormalization, no sqrt: for |c^2 + s^2 - 1| = d it
+     * leaves about 3/4 d^2.  Enough after every composition of near unit
+     * rotations.
+     */
+    Rotation2D<T> & renormalize(void)
+    {
+        const T k = (T(3) - (c * c + s * s)) / T(2);
+
+        c *= k, s *= k;
+        return *this;
+    }
+
+    Rotation2D<T> & operator *= (const Rotation2D<T> & rhs)
+    {
+        const T nc = c * rhs.c - s * rhs.s;
+
+        s = s * rhs.c + c * rhs.s;
+        c = nc;
+        return *this;
+    }
+
+    Rotation2D<T>   operator *  (const Rotation2D<T> & rhs) const { Rotation2D<T> res = *this; return res *= rhs; };
+    Rotation2D<T> & operator /= (const Rotation2D<T> & rhs)       { return *this *= rhs.conj(); };
+    Rotation2D<T>   operator /  (const Rotation2D<T> & rhs) const { return *this * rhs.conj(); };
+
+    private:
+
+    T c, s;
+}; // class Rotation2D
+
+/**
+ * Rotate n SoA vectors by r.
+ *
+ * @param r  The rotation applied to every vector.
+ * @param x  Input X components.
+ * @param y  Input Y components.
+ * @param ox Output X components (may be x).
+ * @param oy Output Y components (may be y).
+ * @param n  Number of vectors.
+ */
+template <typename T>
+inline void
+rotBatch(const Rotation2D<T> & r, const T * x, const T * y, T * ox, T * oy, size_t n)
+{
+    const T c = r.C(), s = r.S();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const T vx = x[i], vy = y[i];
+
+        ox[i] = c * vx - s * vy;
+        oy[i] = s * vx + c * vy;
+    }
+}
+
+/**
+ * Rotate n SoA vectors by r in place.
+ */
+template <typename T>
+inline void
+rotBatch(const Rotation2D<T> & r, T * x, T * y, size_t n)
+{
+    rotBatch(r, x, y, x, y, n);
+}
+
+/**
+ * Rotate an array of n Vector2D<T> by r.
+ *
+ * @param r   The rotation applied to every vector.
+ * @param in  Input vectors.
+ * @param out Output vectors (may be in).
+ * @param n   Number of vectors.
+ */
+template <typename T>
+inline void
+rotBatch(const Rotation2D<T> & r, const Vector2D<T> * in, Vector2D<T> * out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) out[i] = r.rot(in[i]);
+}
+
+/** @class Odometry2D
+*
+* Planar dead reckoning: heading and position from heading increments (yaw
+* gyro, wheel odometry) and travelled distance along the body x axis.
+*
+* Each step moves along the circular arc of constant curvature, which is
+* exact for a constant yaw rate and speed over the step.  Small increments
+* (|dtheta| < 0.1 rad) use series for the arc and the heading increment,
+* no trig call; the heading takes the first order renormalization, no sqrt.
+* A step costs about 30 flops, against two quaternion products and a
+* normalization for the same thing in 3D.
+*/
+template <typename T>
+class Odometry2D
+{
+    public:
+
+    Odometry2D(void) {};
+
+    /** Restart from a given pose.
+     */
+    void reset(const Rotation2D<T> & heading = Rotation2D<T>(), const Vector2D<T> & pos = Vector2D<T>())
+    {
+        r = heading;
+        p = pos;
+    }
+
+    const Rotation2D<T> & heading(void)  const { return r; };
+    const Vector2D<T>   & position(void) const { return p; };
+
+    /**
+     * Advance by one step.
+     *
+     * @param dtheta Heading increment, rad, counterclockwise positive.
+     * @param ds     Distance travelled along the arc.
+     */
+    void update(const T & dtheta, const T & ds)
+    {
+        const T aa = dtheta * dtheta;
+        T sa, ca;   // sin(a) / a, (1 - cos(a)) / a^2
+
+        if (aa < T(1e-2))
+        {
+            // Truncation error below a^6 / 5040 < 2e-10.
+            sa = 1 - aa / 6 + aa * aa / 120;
+            ca = T(1) / 2 - aa / 24 + aa * aa / 720;
+        }
+        else
+        {
+            const T co = PreciseMath::cos(dtheta);
+
+            sa = PreciseMath::sin(dtheta) / dtheta;
+            ca = (1 - co) / aa;
+        }
+
+        // Chord of the arc in the body frame at the start of the step.
+        p += r.rot(Vector2D<T>(ds * sa, ds * dtheta * ca));
+        r *= Rotation2D<T>(1 - aa * ca, dtheta * sa);
+        r.renormalize();
+    }
+
+    /**
+     * Advance by one step of rates.
+     *
+     * @param yawRate Rad/s.
+     * @param speed   Along the body x axis, per s.
+     * @param dt      Step, s.
+     */
+    void updateRates(const T & yawRate, const T & speed, const T & dt) { update(yawRate * dt, speed * dt); };
+
+    /**
+     * Advance by n steps of increments, SoA.
+     */
+    void update(const T * dtheta, const T * ds, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) update(dtheta[i], ds[i]);
+    }
+
+    private:
+
+    Rotation2D<T> r;
+    Vector2D<T>   p;
+}; // class Odometry2D
+
+}; // namespace IMU
+
+#endif //__ROTATION2D_H__
@@ -0,0 +1,219 @@
+#ifndef __ROTATION_MATRIX_H__
+#define __ROTATION_MATRIX_H__
+
+#include <stddef.h>
+
+#include <MathPolicy.h>
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <QuaternionBatch.h>
+
+namespace IMU
+{
+
+/** @class RotationMatrix
+*
+* 3x3 direction cosine matrix, row-major.
+*
+* Built once from a Quaternion<T> (a few dozen flops), it rotates a vector in
+* 9 multiplies instead of the two Hamilton products of Quaternion<T>::rot().
+* apply() gives the same result as rot() of the quaternion it was built from,
+* for non-unit quaternions too (scaled by |q|^2).
+*/
+template <typename T>
+class RotationMatrix
+{
+    public:
+
+    /** Default constructor, identity.
+     */
+    RotationMatrix(void) { for (int i = 0; i < 9; i++) m[i] = (i % 4 == 0) ? T(1) : T(0); };
+
+    /**
+     * Construct from a Quaternion.
+     *
+     * @param q The rotation, normally of unit length.
+     */
+    explicit RotationMatrix(const Quaternion<T> & q) { detail::rotMatrix(q, m); };
+
+    /**
+     * Construct from a row-major array.
+     *
+     * @param a pointer to 9 values of type T
+     */
+    explicit RotationMatrix(const T * a) __attribute__((__nonnull__)) { for (int i = 0; i < 9; i++) m[i] = a[i]; };
+
+    /** Element at row r, column c.
+     */
+    T            operator () (int r, int c) const { return m[r * 3 + c]; };
+    T          & operator () (int r, int c)       { return m[r * 3 + c]; };
+
+    /** The 9 elements, row-major.
+     */
+    const T    * data(void) const { return m; };
+
+    /** Transpose, which for a rotation is its inverse.
+     */
+    RotationMatrix<T> transpose(void) const
+    {
+        const T t[9] = { m[0], m[3], m[6], m[1], m[4], m[7], m[2], m[5], m[8] };
+        return RotationMatrix<T>(t);
+    };
+    RotationMatrix<T> inverse(void) const { return transpose(); };
+
+    /**
+     * Convert back to a unit Quaternion (Shepperd's method).
+     *
+     * Takes the square root of the largest of the four diagonal combinations,
+     * so it stays accurate for every rotation angle.
+     */
+    Quaternion<T>  toQuaternion(void) const;
+
+    /** Rotate one vector.
+     */
+    Vector3D<T>  apply(const Vector3D<T> & v) const
+    {
+        return Vector3D<T>(m[0] * v.X() + m[1] * v.Y() + m[2] * v.Z(),
+                           m[3] * v.X() + m[4] * v.Y() + m[5] * v.Z(),
+                           m[6] * v.X() + m[7] * v.Y() + m[8] * v.Z());
+    };
+    Vector3D<T>  operator * (const Vector3D<T> & v) const { return apply(v); };
+
+    /**
+     * Rotate an array of n Vector3D<T>.
+     *
+     * @param in  Input vectors.
+     * @param out Output vectors (may be in).
+     * @param n   Number of vectors.
+     */
+    void         apply(const Vector3D<T> * in, Vector3D<T> * out, size_t n) const { detail::rot3x3(m, in, out, n); };
+
+    /**
+     * Rotate n SoA vectors, see rotBatch().
+     */
+    void         apply(const T * x, const T * y, const T * z, T * ox, T * oy, T * oz, size_t n) const { detail::rot3x3(m, x, y, z, ox, oy, oz, n); };
+
+    /** Composition: (a * b).apply(v) == a.apply(b.apply(v)).
+     */
+    RotationMatrix<T>   operator *  (const RotationMatrix<T> & rhs) const;
+    RotationMatrix<T> & operator *= (const RotationMatrix<T> & rhs) { *this = *this * rhs; return *this; };
+
+    private:
+
+    T m[9];
+}; // class RotationMatrix
+
+template <typename T>
+RotationMatrix<T>
+RotationMatrix<T>::operator * (const RotationMatrix<T> & rhs) const
+{
+    const T * b = rhs.m;
+    T r[9];
+
+    for (int i = 0; i < 3; i++)
+    {
+        r[i * 3 + 0] = m[i * 3] * b[0] + m[i * 3 + 1] * b[3] + m[i * 3 + 2] * b[6];
+        r[i * 3 + 1] = m[i * 3] * b[1] + m[i * 3 + 1] * b[4] + m[i * 3 + 2] * b[7];
+        r[i * 3 + 2] = m[i * 3] * b[2] + m[i * 3 + 1] * b[5] + m[i * 3 + 2] * b[8];
+    }
+    return RotationMatrix<T>(r);
+}
+
+template <typename T>
+Quaternion<T>
+RotationMatrix<T>::toQuaternion(void) const
+{
+    const T tr = m[0] + m[4] + m[8];
+    T s;
+
+    if (tr >= m[0] && tr >= m[4] && tr >= m[8])
+    {
+        s = 2 * PreciseMath::sqrt(1 + tr);
+        return Quaternion<T>(s / 4, (m[7] - m[5]) / s, (m[2] - m[6]) / s, (m[3] - m[1]) / s);
+    }
+    if (m[0] >= m[4] && m[0] >= m[8])
+    {
+        s = 2 * PreciseMath::sqrt(1 + m[0] - m[4] - m[8]);
+        return Quaternion<T>((m[7] - m[5]) / s, s / 4, (m[1] + m[3]) / s, (m[2] + m[6]) / s);
+    }
+    if (m[4] >= m[8])
+    {
+        s = 2 * PreciseMath::sqrt(1 - m[0] + m[4] - m[8]);
+        return Quaternion<T>((m[2] - m[6]) / s, (m[1] + m[3]) / s, s / 4, (m[5] + m[7]) / s);
+    }
+    s = 2 * PreciseMath::sqrt(1 - m[0] - m[4] + m[8]);
+    return Quaternion<T>((m[3] - m[1]) / s, (m[2] + m[6]) / s, (m[5] + m[7]) / s, s / 4);
+}
+
+/** @class CachedRotation
+*
+* A Quaternion<T> attitude that keeps its RotationMatrix<T> around.
+*
+* The matrix is rebuilt on first use after the attitude changes, so applying
+* one attitude to many vectors or sensor frames per tick costs one
+* conversion plus 9 multiplies per vector.  Not safe to share between
+* threads: even the const accessors may rebuild the cache.
+*/
+template <typename T>
+class CachedRotation
+{
+    public:
+
+    /** Default constructor, identity.
+     */
+    CachedRotation(void) : q(), valid(true) {};
+
+    /** Construct from a Quaternion.
+     */
+    CachedRotation(const Quaternion<T> & q) : q(q), valid(false) {};
+
+    /** Replace the attitude.
+     */
+    CachedRotation<T> & operator = (const Quaternion<T> & rhs) { q = rhs; valid = false; return *this; };
+    CachedRotation<T> & set(const Quaternion<T> & rhs)         { q = rhs; valid = false; return *this; };
+
+    /** Compose the attitude with rhs (q = q * rhs).
+     */
+    CachedRotation<T> & operator *= (const Quaternion<T> & rhs) { q *= rhs; valid = false; return *this; };
+
+    /** Renormalize the attitude.
+     */
+    CachedRotation<T> & normalize(void) { q.normalize(); valid = false; return *this; };
+
+    const Quaternion<T>     & quaternion(void) const { return q; };
+    operator const Quaternion<T> & (void)      const { return q; };
+
+    /** The matrix, rebuilt if the attitude changed since the last call.
+     */
+    const RotationMatrix<T> & matrix(void) const
+    {
+        if (!valid)
+        {
+            m = RotationMatrix<T>(q);
+            valid = true;
+        }
+        return m;
+    };
+
+    /** Rotate one vector, same result as quaternion().rot(v).
+     */
+    Vector3D<T> rot(const Vector3D<T> & v) const { return matrix().apply(v); };
+
+    /** Rotate an array of n Vector3D<T> (out may be in).
+     */
+    void        rot(const Vector3D<T> * in, Vector3D<T> * out, size_t n) const { matrix().apply(in, out, n); };
+
+    /** Rotate n SoA vectors (outputs may be the inputs).
+     */
+    void        rot(const T * x, const T * y, const T * z, T * ox, T * oy, T * oz, size_t n) const { matrix().apply(x, y, z, ox, oy, oz, n); };
+
+    private:
+
+    Quaternion<T>             q;
+    mutable RotationMatrix<T> m;
+    mutable bool              valid;
+}; // class CachedRotation
+
+}; // namespace IMU
+
+#endif //__ROTATION_MATRIX_H__
@@ -0,0 +1,162 @@
+#ifndef __SAMPLE_RING_H__
+#define __SAMPLE_RING_H__
+
+#include <stddef.h>
+#include <atomic>
+
+#include <ImuSample.h>
+
+namespace IMU
+{
+
+/** @class SpscRing
+*
+* Bounded lock-free single producer, single consumer ring of records.
+*
+* The producer either push()es one record or claim()s a contiguous run of
+* free slots, fills them in place and commit()s them.  The consumer peek()s a
+* contiguous run of ready records, processes them straight out of the ring
+* (e.g. MadgwickAHRS<T>::update(span, n)) and release()s them.  Nothing is
+* copied besides the producer's own write and there is one acquire/release
+* pair per batch rather than per record.
+*
+* A run never wraps around the end of the storage, so a batch that straddles
+* it comes back as two runs.  N must be a power of two; one thread produces,
+* one thread consumes.  Producer and consumer indices live on separate cache
+* lines.
+*/
+template <typename R, size_t N>
+class SpscRing
+{
+    static_assert(N != 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+    public:
+
+    /** Default constructor, empty.
+     */
+    SpscRing(void) : head(0), tailCache(0), tail(0), headCache(0) {};
+
+    /** Capacity in records.
+     */
+    static size_t capacity(void) { return N; };
+
+    /** Number of records ready for the consumer (approximate from the producer side).
+     */
+    size_t size(void) const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); };
+
+    // Producer side
+
+    /**
+     * Append one record.
+     *
+     * @param r The record.
+     *
+     * @return false if the ring is full.
+     */
+    bool push(const R & r)
+    {
+        size_t n = 1;
+        R * slot = claim(n);
+
+        if (n == 0) return false;
+        *slot = r;
+        commit(1);
+        return true;
+    }
+
+    /**
+     * Borrow contiguous free slots to fill in place.
+     *
+     * @param n In: slots wanted.  Out: slots available (may be fewer, 0 if full).
+     *
+     * @return Pointer to the first free slot.
+     */
+    R * claim(size_t & n)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        size_t room = N - (h - tailCache);
+
+        if (room < n)
+        {
+            tailCache = tail.load(std::memory_order_acquire);
+            room = N - (h - tailCache);
+        }
+        n = min(n, min(room, N - (h & (N - 1))));
+
+        return &buf[h & (N - 1)];
+    }
+
+    /**
+     * Publish the first n slots returned by claim().
+     */
+    void commit(size_t n) { head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release); };
+
+    // Consumer side
+
+    /**
+     * Borrow contiguous ready records.
+     *
+     * @param n In: records wanted.  Out: records available (may be fewer, 0 if empty).
+     *
+     * @return Pointer to the oldest ready record.
+     */
+    const R * peek(size_t & n)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        size_t ready = headCache - t;
+
+        if (ready < n)
+        {
+            headCache = head.load(std::memory_order_acquire);
+            ready = headCache - t;
+        }
+        n = min(n, min(ready, N - (t & (N - 1))));
+
+        return &buf[t & (N - 1)];
+    }
+
+    /**
+     * Hand the first n records returned by peek() back to the producer.
+     */
+    void release(size_t n) { tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release); };
+
+    /**
+     * Remove and copy out the oldest record.
+     *
+     * @return false if the ring is empty.
+     */
+    bool pop(R & r)
+    {
+        size_t n = 1;
+        const R * rec = peek(n);
+
+        if (n == 0) return false;
+        r = *rec;
+        release(1);
+        return true;
+    }
+
+    private:
+
+    static size_t min(size_t a, size_t b) { return (a < b) ? a : b; };
+
+    // Producer's line: its index and its last view of the consumer's.
+    alignas(64) std::atomic<size_t> head;
+    size_t                          tailCache;
+
+    // Consumer's line.
+    alignas(64) std::atomic<size_t> tail;
+    size_t                          headCache;
+
+    alignas(64) R buf[N];
+
+}; // class SpscRing
+
+/** Ring of timestamped IMU samples.
+ */
+template <typename T, size_t N>
+using ImuSampleRing = SpscRing<ImuSample<T>, N>;
+
+}; // namespace IMU
+
+#endif //__SAMPLE_RING_H__
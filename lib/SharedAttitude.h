@@ -0,0 +1,217 @@
+#ifndef __SHARED_ATTITUDE_H__
+#define __SHARED_ATTITUDE_H__
+
+#include <stdint.h>
+#include <atomic>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+
+namespace IMU
+{
+
+/** @class SeqLock
+*
+* Single writer, multi reader sequence lock over N values of type T.
+*
+* The writer never waits: it bumps the sequence to odd, stores the values and
+* bumps it back to even.  Readers copy the values and retry if the sequence
+* was odd or changed meanwhile, so they can never return a torn set.  The
+* values are relaxed atomics, which compile to plain loads and stores for
+* float and double but keep the concurrent access well defined.
+*
+* Exactly one thread may call write().  Aligned to a cache line so nothing
+* else shares it.
+*/
+template <typename T, int N>
+class alignas(64) SeqLock
+{
+    public:
+
+    /** Default constructor, all values zero.
+     */
+    SeqLock(void) : seq(0) { for (int i = 0; i < N; i++) data[i].store(T(0), std::memory_order_relaxed); };
+
+    /**
+     * Publish N new values.  Wait-free, writer thread only.
+     *
+     * @param v The values.
+     */
+    void write(const T * v)
+    {
+        const uint32_t s = seq.load(std::memory_order_relaxed);
+
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < N; i++)
+        {
+            data[i].store(v[i], std::memory_order_relaxed);
+        }
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    /**
+     * Try to take a consistent copy.
+     *
+     * @param v Receives the N values, only meaningful on success.
+     *
+     * @return false if a write was in progress or overlapped the copy.
+     */
+    bool tryRead(T * v) const
+    {
+        const uint32_t s0 = seq.load(std::memory_order_acquire);
+
+        if (s0 & 1) return false;
+        for (int i = 0; i < N; i++)
+        {
+            v[i] = data[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return s0 == seq.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Take a consistent copy, retrying until no write overlaps it.
+     *
+     * @param v Receives the N values.
+     *
+     * @return Number of retries needed.
+     */
+    uint32_t read(T * v) const
+    {
+        uint32_t retries = 0;
+
+        while (!tryRead(v))
+        {
+            retries++;
+#if defined(__SSE2__)
+            _mm_pause();
+#endif
+        }
+        return retries;
+    }
+
+    /** Number of completed writes.
+     */
+    uint32_t version(void) const { return seq.load(std::memory_order_acquire) >> 1; };
+
+    private:
+
+    std::atomic<uint32_t> seq;
+    std::atomic<T>        data[N];
+
+}; // class SeqLock
+
+/** @class SharedAttitude
+*
+* Attitude and angular rate handed from one producer (sensor thread or ISR)
+* to any number of consumers without locks and without torn reads.
+*
+* Replaces sharing a volatile Quaternion<T>: volatile stops the compiler from
+* caching the components but does not make the four of them change together.
+*/
+template <typename T>
+class SharedAttitude
+{
+    public:
+
+    /**
+     * Publish a new attitude.  Wait-free, producer only.
+     *
+     * @param q    Attitude.
+     * @param rate Angular rate, optional.
+     */
+    void publish(const Quaternion<T> & q, const Vector3D<T> & rate = Vector3D<T>())
+    {
+        const T v[7] = { q.W(), q.X(), q.Y(), q.Z(), rate.X(), rate.Y(), rate.Z() };
+
+        lock.write(v);
+    }
+
+    /**
+     * Read attitude and rate consistently, retrying on conflict.
+     *
+     * @param q    Receives the attitude.
+     * @param rate Receives the angular rate.
+     */
+    void read(Quaternion<T> & q, Vector3D<T> & rate) const
+    {
+        T v[7];
+
+        lock.read(v);
+        q.set(v[0], v[1], v[2], v[3]);
+        rate.set(v[4], v[5], v[6]);
+    }
+
+    /**
+     * Read attitude and rate, without retrying.
+     *
+     * @return false (and q, rate untouched) if a publish overlapped.
+     */
+    bool tryRead(Quaternion<T> & q, Vector3D<T> & rate) const
+    {
+        T v[7];
+
+        if (!lock.tryRead(v)) return false;
+        q.set(v[0], v[1], v[2], v[3]);
+        rate.set(v[4], v[5], v[6]);
+        return true;
+    }
+
+    /** Latest attitude.
+     */
+    Quaternion<T> attitude(void) const { Quaternion<T> q; Vector3D<T> rate; read(q, rate); return q; };
+
+    /** Latest angular rate.
+     */
+    Vector3D<T>   rate(void)     const { Quaternion<T> q; Vector3D<T> rate; read(q, rate); return rate; };
+
+    /** Number of publishes so far, for spotting new data.
+     */
+    uint32_t      version(void)  const { return lock.version(); };
+
+    private:
+
+    SeqLock<T, 7> lock;
+
+}; // class SharedAttitude
+
+/** @class SharedVector3D
+*
+* A Vector3D<T> handed from one producer to many consumers, see SharedAttitude.
+*/
+template <typename T>
+class SharedVector3D
+{
+    public:
+
+    /** Publish a new value.  Wait-free, producer only.
+     */
+    void publish(const Vector3D<T> & vec) { const T v[3] = { vec.X(), vec.Y(), vec.Z() }; lock.write(v); };
+
+    /** Latest value, retrying on conflict.
+     */
+    Vector3D<T> read(void) const { T v[3]; lock.read(v); return Vector3D<T>(v[0], v[1], v[2]); };
+
+    /** Latest value without retrying, false (and vec untouched) if a publish overlapped.
+     */
+    bool tryRead(Vector3D<T> & vec) const { T v[3]; if (!lock.tryRead(v)) return false; vec.set(v[0], v[1], v[2]); return true; };
+
+    /** Number of publishes so far.
+     */
+    uint32_t version(void) const { return lock.version(); };
+
+    private:
+
+    SeqLock<T, 3> lock;
+
+}; // class SharedVector3D
+
+}; // namespace IMU
+
+#endif //__SHARED_ATTITUDE_H__
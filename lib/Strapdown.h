@@ -0,0 +1,246 @@
+#ifndef __STRAPDOWN_H__
+#define __STRAPDOWN_H__
+
+#include <stddef.h>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <ImuSample.h>
+#include <FastMath.h>
+#include <MathPolicy.h>
+
+namespace IMU
+{
+
+/**
+ * Rotation vector exponential map.
+ *
+ * Returns the unit quaternion that rotates by |phi| about phi.  Small
+ * angles use the Taylor series of cos(a/2) and sin(a/2)/a, which avoids
+ * both the trig calls and the 0/0 at a = 0.
+ *
+ * @param phi Rotation vector, rad.
+ */
+template <typename T>
+inline Quaternion<T>
+expMap(const Vector3D<T> & phi)
+{
+    const T aa = phi.dot(phi);
+    T c, s;
+
+    if (aa < T(1e-2))
+    {
+        // Truncation error below a^6 / 46080 < 2.2e-11.
+        c = 1 - aa / 8 + aa * aa / 384;
+        s = T(1) / 2 - aa / 48 + aa * aa / 3840;
+    }
+    else
+    {
+        const T a = PreciseMath::sqrt(aa);
+
+        c = PreciseMath::cos(a / 2);
+        s = PreciseMath::sin(a / 2) / a;
+    }
+    return Quaternion<T>(c, s * phi.X(), s * phi.Y(), s * phi.Z());
+}
+
+/** @class StrapdownIntegrator
+*
+* High rate part of a strapdown mechanization.
+*
+* Accumulates gyro angle increments and accel velocity increments over one
+* navigation interval, with the coning correction for the attitude and the
+* sculling and rotation corrections for the velocity (Savage's recursive
+* forms, exact for a linearly ramping rate).  Per sample it is only adds and
+* three cross products, no normalization and no quaternion.
+*
+* Increments should come from integrating sensors (delta-theta, delta-v)
+* where available; addRates(gyro, accel, dt) takes rates instead and turns
+* them into rectangular increments.
+*/
+template <typename T>
+class StrapdownIntegrator
+{
+    public:
+
+    StrapdownIntegrator(void) { reset(); };
+
+    /** Forget everything, including the previous sample used by the corrections.
+     */
+    void reset(void)
+    {
+        prevTheta = prevV = Vector3D<T>();
+        restart();
+    }
+
+    /** Start a new navigation interval.
+     */
+    void restart(void)
+    {
+        alpha = beta = upsilon = scul = Vector3D<T>();
+        dt = 0;
+        n = 0;
+    }
+
+    /**
+     * Add one sample of increments.
+     *
+     * @param dtheta Angle increment, body frame, rad.
+     * @param dv     Velocity increment, body frame, m/s.
+     * @param step   Sample interval, s.
+     */
+    void add(const Vector3D<T> & dtheta, const Vector3D<T> & dv, const T & step)
+    {
+        const T sixth = T(1) / 6, half = T(1) / 2;
+        const Vector3D<T> a = alpha + prevTheta * sixth;
+        const Vector3D<T> u = upsilon + prevV * sixth;
+
+        beta += a.cross(dtheta) * half;
+        scul += (a.cross(dv) + u.cross(dtheta)) * half;
+
+        alpha   += dtheta;
+        upsilon += dv;
+        prevTheta = dtheta;
+        prevV     = dv;
+        dt += step;
+        n++;
+    }
+
+    /**
+     * Add one sample of rates.
+     *
+     * @param gyro  Angular rate, rad/s.
+     * @param accel Specific force, m/s^2.
+     * @param step  Sample interval, s.
+     */
+    void addRates(const Vector3D<T> & gyro, const Vector3D<T> & accel, const T & step) { add(gyro * step, accel * step, step); };
+
+    /** Samples in the current interval.
+     */
+    size_t count(void)    const { return n; };
+
+    /** Length of the current interval, s.
+     */
+    T      interval(void) const { return dt; };
+
+    /** Body rotation vector over the interval, coning corrected.
+     */
+    Vector3D<T> rotation(void) const { return alpha + beta; };
+
+    /** Velocity increment over the interval in the body frame at its start,
+     *  rotation and sculling corrected.
+     */
+    Vector3D<T> velocity(void) const { return upsilon + alpha.cross(upsilon) * (T(1) / 2) + scul; };
+
+    private:
+
+    Vector3D<T> alpha;      // sum of dtheta
+    Vector3D<T> beta;       // coning
+    Vector3D<T> upsilon;    // sum of dv
+    Vector3D<T> scul;       // sculling
+    Vector3D<T> prevTheta;
+    Vector3D<T> prevV;
+    T           dt;
+    size_t      n;
+}; // class StrapdownIntegrator
+
+/** @class Strapdown
+*
+* Strapdown attitude, velocity and position at the navigation rate.
+*
+* Feed the high rate increments to integrator(), then call update() once per
+* navigation tick.  The attitude takes one quaternion product with expMap()
+* of the coning corrected rotation vector and one normalization per tick.
+* Velocity adds the sculling corrected increment rotated into the navigation
+* frame plus gravity; position integrates velocity with the trapezoid rule.
+*
+* The navigation frame is a local level frame treated as inertial (no earth
+* rate or transport rate), z up like Quaternion<T>::gVec(), which is fine
+* for the short ranges and durations of a vehicle or handheld sensor.
+*/
+template <typename T>
+class Strapdown
+{
+    public:
+
+    /**
+     * Constructor.
+     *
+     * @param gravity Gravity in the navigation frame, m/s^2.
+     */
+    explicit Strapdown(const Vector3D<T> & gravity = Vector3D<T>(0, 0, T(-9.80665))) : g(gravity) { reset(); };
+
+    /**
+     * Restart from a given state.
+     */
+    void reset(const Quaternion<T> & att = Quaternion<T>(), const Vector3D<T> & vel = Vector3D<T>(), const Vector3D<T> & pos = Vector3D<T>())
+    {
+        q = att;
+        v = vel;
+        p = pos;
+        acc.reset();
+    }
+
+    const Quaternion<T> & attitude(void) const { return q; };
+    const Vector3D<T>   & velocity(void) const { return v; };
+    const Vector3D<T>   & position(void) const { return p; };
+
+    /** The high rate accumulator for the current interval.
+     */
+    StrapdownIntegrator<T> & integrator(void) { return acc; };
+
+    /** Shorthand for integrator().add().
+     */
+    void add(const Vector3D<T> & dtheta, const Vector3D<T> & dv, const T & step) { acc.add(dtheta, dv, step); };
+
+    /**
+     * Close the current interval: update attitude, velocity and position and
+     * restart the integrator.  Does nothing for an empty interval.
+     */
+    void update(void);
+
+    /**
+     * Integrate n rate samples as one navigation interval.
+     *
+     * @param s    Samples, gyro in rad/s and accel in m/s^2.
+     * @param n    Number of samples.
+     * @param step Sample interval, s.
+     */
+    void update(const ImuSample<T> * s, size_t n, const T & step)
+    {
+        for (size_t i = 0; i < n; i++) acc.addRates(s[i].gyro, s[i].accel, step);
+        update();
+    }
+
+    private:
+
+    Quaternion<T>          q;
+    Vector3D<T>            v;
+    Vector3D<T>            p;
+    Vector3D<T>            g;
+    StrapdownIntegrator<T> acc;
+}; // class Strapdown
+
+template <typename T>
+void
+Strapdown<T>::update(void)
+{
+    const T dt = acc.interval();
+
+    if (!acc.count()) return;
+
+    // Velocity increment is referenced to the body frame at the start of the interval.
+    const Vector3D<T> v0 = v;
+
+    v += q.rot(acc.velocity()) + g * dt;
+    p += (v0 + v) * (dt / 2);
+
+    q *= expMap(acc.rotation());
+    q *= rsqrt(q.dot(q));
+
+    acc.restart();
+}
+
+}; // namespace IMU
+
+#endif //__STRAPDOWN_H__
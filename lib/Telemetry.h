@@ -0,0 +1,274 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(IMU_TELEMETRY)
+#include <atomic>
+#include <mutex>
+#endif
+
+/*
+ * Numerical telemetry for the hot paths.
+ *
+ * Build with -DIMU_TELEMETRY to count normalizations, degenerate inputs and
+ * clamps, and to histogram how far quaternion norms drifted from 1 before
+ * each renormalization.  Without it IMU_TELEMETRY_HOOK(...) expands to nothing,
+ * its argument is not even evaluated, and snapshot() returns zeros.
+ *
+ * Counters are per thread: each thread increments its own slot with relaxed
+ * stores, no locked instruction and no shared cache line.  snapshot() sums
+ * the live slots plus those of threads that have exited.
+ */
+#if defined(IMU_TELEMETRY)
+#define IMU_TELEMETRY_HOOK(call) ::IMU::telemetry::call
+#else
+#define IMU_TELEMETRY_HOOK(call) ((void)0)
+#endif
+
+namespace IMU
+{
+
+enum TelemetryCounter
+{
+    TELEMETRY_QUAT_NORMALIZE = 0,   // Quaternion normalize() / norm()
+    TELEMETRY_QUAT_DEGENERATE,      // ... skipped, length <= MIN_NORM
+    TELEMETRY_VEC_NORMALIZE,        // Vector3D normalize() / norm()
+    TELEMETRY_VEC_DEGENERATE,       // ... of a zero (or NaN) length vector
+    TELEMETRY_DUAL_POW_CLAMP,       // Dual pow() derivative with |real| clamped to 1e-15
+    TELEMETRY_UNIT_RENORMALIZE,     // UnitQuaternion norm corrections
+    TELEMETRY_COUNTERS
+};
+
+enum TelemetryHistogram
+{
+    TELEMETRY_QUAT_DRIFT = 0,       // |length - 1| seen by Quaternion normalize() / norm()
+    TELEMETRY_HISTOGRAMS
+};
+
+/** Histogram buckets are decades: bucket 0 is below 1e-12, bucket b in 1 .. 11
+ *  is [10^(b-13), 10^(b-12)), bucket 12 is 1e-1 and above.
+ */
+static const int TELEMETRY_BUCKETS = 13;
+
+/** @class TelemetrySnapshot
+*
+* Totals over all threads at one point in time.  Subtract two snapshots to
+* get the activity in between.
+*/
+struct TelemetrySnapshot
+{
+    TelemetrySnapshot(void)
+    {
+        for (int i = 0; i < TELEMETRY_COUNTERS; i++) counter[i] = 0;
+        for (int h = 0; h < TELEMETRY_HISTOGRAMS; h++)
+            for (int b = 0; b < TELEMETRY_BUCKETS; b++) histogram[h][b] = 0;
+    }
+
+    TelemetrySnapshot operator - (const TelemetrySnapshot & rhs) const
+    {
+        TelemetrySnapshot res;
+
+        for (int i = 0; i < TELEMETRY_COUNTERS; i++) res.counter[i] = counter[i] - rhs.counter[i];
+        for (int h = 0; h < TELEMETRY_HISTOGRAMS; h++)
+            for (int b = 0; b < TELEMETRY_BUCKETS; b++) res.histogram[h][b] = histogram[h][b] - rhs.histogram[h][b];
+        return res;
+    }
+
+    /** Upper limit of bucket b (the last bucket has none, returns 0).
+     */
+    static double bucketLimit(int b)
+    {
+        static const double limit[TELEMETRY_BUCKETS] = { 1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 0 };
+
+        return limit[b];
+    }
+
+    static const char * name(TelemetryCounter c)
+    {
+        static const char * const names[TELEMETRY_COUNTERS] = { "quat_normalize", "quat_degenerate", "vec_normalize", "vec_degenerate", "dual_pow_clamp", "unit_renormalize" };
+
+        return names[c];
+    }
+
+    uint64_t counter[TELEMETRY_COUNTERS];
+    uint64_t histogram[TELEMETRY_HISTOGRAMS][TELEMETRY_BUCKETS];
+}; // struct TelemetrySnapshot
+
+namespace telemetry
+{
+
+/** True when built with IMU_TELEMETRY.
+ */
+inline bool
+enabled(void)
+{
+#if defined(IMU_TELEMETRY)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if defined(IMU_TELEMETRY)
+
+/** One thread's counters.  Only the owning thread writes them.
+ */
+struct alignas(64) Slot
+{
+    std::atomic<uint64_t> counter[TELEMETRY_COUNTERS];
+    std::atomic<uint64_t> histogram[TELEMETRY_HISTOGRAMS][TELEMETRY_BUCKETS];
+    Slot                * next;
+
+    void addTo(TelemetrySnapshot & s) const
+    {
+        for (int i = 0; i < TELEMETRY_COUNTERS; i++) s.counter[i] += counter[i].load(std::memory_order_relaxed);
+        for (int h = 0; h < TELEMETRY_HISTOGRAMS; h++)
+            for (int b = 0; b < TELEMETRY_BUCKETS; b++) s.histogram[h][b] += histogram[h][b].load(std::memory_order_relaxed);
+    }
+};
+
+/** Live slots plus the totals of exited threads.
+ */
+struct Registry
+{
+    Registry(void) : head(0) {};
+
+    std::mutex        m;
+    Slot            * head;
+    TelemetrySnapshot retired;
+};
+
+inline Registry &
+registry(void)
+{
+    static Registry r;
+    return r;
+}
+
+/** Registers the thread's slot on first use, folds it into the retired totals at thread exit.
+ */
+struct ThreadSlot
+{
+    ThreadSlot(void)
+    {
+        Registry & r = registry();
+
+        for (int i = 0; i < TELEMETRY_COUNTERS; i++) slot.counter[i].store(0, std::memory_order_relaxed);
+        for (int h = 0; h < TELEMETRY_HISTOGRAMS; h++)
+            for (int b = 0; b < TELEMETRY_BUCKETS; b++) slot.histogram[h][b].store(0, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(r.m);
+        slot.next = r.head;
+        r.head = &slot;
+    }
+
+    ~ThreadSlot(void)
+    {
+        Registry & r = registry();
+        std::lock_guard<std::mutex> lock(r.m);
+
+        slot.addTo(r.retired);
+        for (Slot ** p = &r.head; *p; p = &(*p)->next)
+        {
+            if (*p == &slot)
+            {
+                *p = slot.next;
+                break;
+            }
+        }
+    }
+
+    Slot slot;
+};
+
+inline Slot &
+local(void)
+{
+    static thread_local ThreadSlot t;
+    return t.slot;
+}
+
+/** Single writer increment: a relaxed load and store, no lock prefix.
+ */
+inline void
+bump(std::atomic<uint64_t> & c)
+{
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline void
+count(TelemetryCounter c)
+{
+    bump(local().counter[c]);
+}
+
+inline void
+record(TelemetryHistogram h, double v)
+{
+    int b = 0;
+
+    if (!(v >= 0)) v = -v;
+    while (b < TELEMETRY_BUCKETS - 1 && !(v < TelemetrySnapshot::bucketLimit(b))) b++;
+    bump(local().histogram[h][b]);
+}
+
+/** Drift is only recorded for the built in floating point types. */
+template <typename T> inline void drift(const T &) {};
+inline void drift(float d)       { record(TELEMETRY_QUAT_DRIFT, d); };
+inline void drift(double d)      { record(TELEMETRY_QUAT_DRIFT, d); };
+inline void drift(long double d) { record(TELEMETRY_QUAT_DRIFT, (double)d); };
+
+/**
+ * Quaternion normalize() / norm() hook.
+ *
+ * @param len     The length about to be divided by.
+ * @param minNorm Quaternion<T>::MIN_NORM.
+ */
+template <typename T>
+inline void
+quaternionNorm(const T & len, const T & minNorm)
+{
+    count(TELEMETRY_QUAT_NORMALIZE);
+    if (len > minNorm) drift(len - T(1));
+    else               count(TELEMETRY_QUAT_DEGENERATE);
+}
+
+/** Vector3D normalize() / norm() hook.
+ */
+template <typename T>
+inline void
+vectorNorm(const T & len)
+{
+    count(TELEMETRY_VEC_NORMALIZE);
+    if (!(len > T(0))) count(TELEMETRY_VEC_DEGENERATE);
+}
+
+/**
+ * Totals over all threads.  Counts from other threads are read with relaxed
+ * loads, so a snapshot taken while they run is approximate by the few
+ * increments in flight.
+ */
+inline TelemetrySnapshot
+snapshot(void)
+{
+    Registry & r = registry();
+    std::lock_guard<std::mutex> lock(r.m);
+    TelemetrySnapshot s = r.retired;
+
+    for (const Slot * p = r.head; p; p = p->next) p->addTo(s);
+    return s;
+}
+
+#else
+
+inline TelemetrySnapshot snapshot(void) { return TelemetrySnapshot(); };
+
+#endif // IMU_TELEMETRY
+
+}; // namespace telemetry
+
+}; // namespace IMU
+
+#endif //__TELEMETRY_H__
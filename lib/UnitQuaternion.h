@@ -0,0 +1,176 @@
+#ifndef __UNIT_QUATERNION_H__
+#define __UNIT_QUATERNION_H__
+
+#include <float.h>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <Telemetry.h>
+
+namespace IMU
+{
+
+/** @class UnitQuaternionTraits
+*
+* Error model for UnitQuaternion<T>.
+*
+* roundoff() bounds what one Hamilton product adds to |q.q - 1| (a few ulps
+* per component, 8 eps is conservative).  tolerance() is the bound at which
+* the quaternion gets renormalized; it sits near sqrt(eps) because the
+* first order correction leaves about 3/4 of the square of the error.
+* Specialize for other types; the generic version suits float-like types.
+*/
+template <typename T>
+struct UnitQuaternionTraits
+{
+    static T roundoff(void)  { return T(1e-6); };
+    static T tolerance(void) { return T(2.5e-4); };
+};
+
+template <>
+struct UnitQuaternionTraits<float>
+{
+    static float roundoff(void)  { return 8 * FLT_EPSILON; };
+    static float tolerance(void) { return 1.0f / 4096; };                // 2^-12
+};
+
+template <>
+struct UnitQuaternionTraits<double>
+{
+    static double roundoff(void)  { return 8 * DBL_EPSILON; };
+    static double tolerance(void) { return 1.0 / 67108864; };           // 2^-26
+};
+
+template <>
+struct UnitQuaternionTraits<long double>
+{
+    static long double roundoff(void)  { return 8 * LDBL_EPSILON; };
+    static long double tolerance(void) { return 1.0L / 4294967296.0L; }; // 2^-32
+};
+
+/** @class UnitQuaternion
+*
+* A rotation: a Quaternion<T> that is kept unit length lazily.
+*
+* Every operation adds to a bound on |q.q - 1| instead of renormalizing.
+* Only when the bound passes UnitQuaternionTraits<T>::tolerance() is the
+* actual norm measured and corrected with the first order Taylor step
+* q *= (3 - q.q) / 2, no sqrt and no division.  The inverse is conj().
+*
+* Between corrections the norm is off by at most the tolerance, which is
+* what a rotated vector's length is off by as well.  normalize() forces an
+* exact sqrt normalization when that matters.
+*/
+template <typename T>
+class UnitQuaternion
+{
+    public:
+
+    typedef UnitQuaternionTraits<T> Traits;
+
+    /** Identity rotation.
+     */
+    UnitQuaternion(void) : q(), err(0) {};
+
+    /**
+     * From any nonzero Quaternion<T>.  Measures the norm; near unit quaternions
+     * (small angle increments, the result of a Quaternion<T> product) take
+     * the cheap correction, anything else an exact normalization.
+     */
+    explicit UnitQuaternion(const Quaternion<T> & rhs) : q(rhs), err(0) { correct(); };
+
+    /**
+     * From the components, see UnitQuaternion(const Quaternion<T> &).
+     */
+    UnitQuaternion(const T w, const T x, const T y, const T z) : q(w, x, y, z), err(0) { correct(); };
+
+    /**
+     * Wrap a quaternion known to be unit to within bound, e.g. an expMap()
+     * result or a first order increment (1, dtheta / 2) whose norm error is
+     * |dtheta|^2 / 4.  No measurement, no correction.
+     */
+    static UnitQuaternion<T> assumeUnit(const Quaternion<T> & rhs, const T & bound = Traits::roundoff()) { return UnitQuaternion<T>(rhs, bound); };
+
+    // Attribute readers...
+    const Quaternion<T> & quaternion(void) const { return q; };
+    operator const Quaternion<T> & (void)  const { return q; };
+    T             W(void) const { return q.W(); };
+    T             X(void) const { return q.X(); };
+    T             Y(void) const { return q.Y(); };
+    T             Z(void) const { return q.Z(); };
+
+    /** Current bound on |q.q - 1|.
+     */
+    T             errorBound(void) const { return err; };
+
+    /** Inverse rotation, exact for a unit quaternion.
+     */
+    UnitQuaternion<T> conj(void)    const { return UnitQuaternion<T>(q.conj(), err); };
+    UnitQuaternion<T> inverse(void) const { return conj(); };
+
+    /**
+     * Rotate a vector.
+     *
+     * Uses v + w t + u x t with t = 2 u x v, which assumes a unit quaternion
+     * and is about half the work of Quaternion<T>::rot().
+     */
+    Vector3D<T> rot(const Vector3D<T> & v) const
+    {
+        const Vector3D<T> u = q.imag();
+        const Vector3D<T> t = u.cross(v) * T(2);
+
+        return v + t * q.W() + u.cross(t);
+    }
+
+    /** Correct the norm now, with the first order step.
+     */
+    UnitQuaternion<T> & renormalize(void) { correct(); return *this; };
+
+    /** Exact sqrt normalization.
+     */
+    UnitQuaternion<T> & normalize(void) { q.normalize(); err = Traits::roundoff(); return *this; };
+
+    UnitQuaternion<T> & operator *= (const UnitQuaternion<T> & rhs)
+    {
+        q *= rhs.q;
+        err = err + rhs.err + err * rhs.err + Traits::roundoff();
+        if (err > Traits::tolerance()) correct();
+        return *this;
+    }
+
+    UnitQuaternion<T>   operator *  (const UnitQuaternion<T> & rhs) const { UnitQuaternion<T> res = *this; return res *= rhs; };
+    UnitQuaternion<T> & operator /= (const UnitQuaternion<T> & rhs)       { return *this *= rhs.conj(); };
+    UnitQuaternion<T>   operator /  (const UnitQuaternion<T> & rhs) const { return *this * rhs.conj(); };
+
+    private:
+
+    UnitQuaternion(const Quaternion<T> & rhs, const T & e) : q(rhs), err(e) {};
+
+    void correct(void)
+    {
+        const T n2 = q.dot(q);
+        const T d  = n2 - T(1);
+        const T ad = (d < T(0)) ? -d : d;
+
+        IMU_TELEMETRY_HOOK(count(TELEMETRY_UNIT_RENORMALIZE));
+        if (ad < T(1) / 8)
+        {
+            // |q (3 - n2) / 2|^2 = 1 - 3/4 d^2 + 1/4 d^3
+            q *= (T(3) - n2) / T(2);
+            err = d * d * (T(3) / T(4) + ad / T(4)) + Traits::roundoff();
+            if (err > Traits::tolerance()) correct();
+        }
+        else
+        {
+            q.normalize();
+            err = Traits::roundoff();
+        }
+    }
+
+    Quaternion<T> q;
+    T             err;
+}; // class UnitQuaternion
+
+}; // namespace IMU
+
+#endif //__UNIT_QUATERNION_H__
@@ -1,9 +1,16 @@
 #ifndef __VECTOR2D_H__
 #define __VECTOR2D_H__
 
+#include <MathPolicy.h>
+
 namespace IMU
 {
 
+/** @class Vector2D
+*
+* This class implements the Vector2D type, the planar counterpart of Vector3D.
+*
+*/
 template <typename T>
 class Vector2D
 {
@@ -29,20 +36,37 @@ class Vector2D
     T X(void) const { return x; };
     T Y(void) const { return y; };
 
+    /** Attribute writer
+     */
+    void set(T x, T y) { this->x = x, this->y = y; };
+
     T dot(const Vector2D<T> & v) const { return x*v.x+y*v.y; };
-    T length(void) const { return sqrt(dot(*this)); };
+
+    /** The z component of the 3D cross product, positive when v is counterclockwise of this.
+     */
+    T cross(const Vector2D<T> & v) const { return x*v.y-y*v.x; };
+
+    /** This vector rotated counterclockwise by 90 degrees.
+     */
+    Vector2D<T> perp(void) const { return Vector2D<T>(-y, x); };
+
+    T length(void) const { return PreciseMath::sqrt(dot(*this)); };
 
     // Operators
-    Vector2D<T> & operator += (const Vector2D<T> & rhs);
-    Vector2D<T> & operator -= (const Vector2D<T> & rhs);
-    Vector2D<T> & operator *= (const Vector2D<T> & rhs);
-    Vector2D<T> & operator /= (const Vector2D<T> & rhs);
+    Vector2D<T> & operator += (const Vector2D<T> & rhs) { x += rhs.x, y += rhs.y; return *this; };
+    Vector2D<T> & operator -= (const Vector2D<T> & rhs) { x -= rhs.x, y -= rhs.y; return *this; };
+    Vector2D<T> & operator *= (const Vector2D<T> & rhs) { x *= rhs.x, y *= rhs.y; return *this; };
+    Vector2D<T> & operator /= (const Vector2D<T> & rhs) { x /= rhs.x, y /= rhs.y; return *this; };
 
     Vector2D<T> & operator += (const T & rhs) { x += rhs, y += rhs; return *this; };
     Vector2D<T> & operator -= (const T & rhs) { x -= rhs, y -= rhs; return *this; };
     Vector2D<T> & operator *= (const T & rhs) { x *= rhs, y *= rhs; return *this; };
     Vector2D<T> & operator /= (const T & rhs) { x /= rhs, y /= rhs; return *this; };
 
+    Vector2D<T> & operator  = (const Vector2D<T> & rhs) { x = rhs.x, y = rhs.y; return *this; };
+
+    Vector2D<T>   operator  - (void) const { return Vector2D<T>(-x, -y); };
+
     private:
 
     T x, y;
@@ -88,5 +112,55 @@ operator - (const Vector2D<T> &lhs, const T &rhs)
     return res;
 }
 
+template <typename T>
+inline Vector2D<T>
+operator * (const Vector2D<T> &lhs, const Vector2D<T> &rhs)
+{
+    Vector2D<T> res = lhs;
+
+    res *= rhs;
+    return res;
+}
+
+template <typename T>
+inline Vector2D<T>
+operator / (const Vector2D<T> &lhs, const Vector2D<T> &rhs)
+{
+    Vector2D<T> res = lhs;
+
+    res /= rhs;
+    return res;
+}
+
+template <typename T>
+inline Vector2D<T>
+operator * (const Vector2D<T> &lhs, const T &rhs)
+{
+    Vector2D<T> res = lhs;
+
+    res *= rhs;
+    return res;
+}
+
+template <typename T>
+inline Vector2D<T>
+operator * (const T &lhs, const Vector2D<T> &rhs)
+{
+    Vector2D<T> res = rhs;
+
+    res *= lhs;
+    return res;
+}
+
+template <typename T>
+inline Vector2D<T>
+operator / (const Vector2D<T> &lhs, const T &rhs)
+{
+    Vector2D<T> res = lhs;
+
+    res /= rhs;
+    return res;
+}
+
 }; // namespace IMU
 #endif //__VECTOR2D_H__
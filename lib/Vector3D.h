@@ -1,6 +1,9 @@
 #ifndef __VECTOR3D_H__
 #define __VECTOR3D_H__
 
+#include <MathPolicy.h>
+#include <Telemetry.h>
+
 namespace IMU
 {
 
@@ -64,8 +67,12 @@ class Vector3D
     Vector3D<T>  cross(const Vector3D<T> & v) const { return Vector3D<T>((y*v.z-z*v.y), (z*v.x-x*v.z), (x*v.y-y*v.x)); };
 
     /** Vector length
+     *
+     * The template version takes the math policy, e.g. v.length<ApproxMath>().
      */
-    T            length(void) const { return sqrt(dot(*this)); };
+    T            length(void) const { return PreciseMath::sqrt(dot(*this)); };
+    template <class M>
+    T            length(void) const { return M::sqrt(dot(*this)); };
 
     /** Vector norm (returns normalized copy).
      *
@@ -73,7 +80,7 @@ class Vector3D
      *
      * @return The normalized copy of the vector.
      */
-    Vector3D<T>  norm(void) const { T invlen = 1 / this->length(); return Vector3D<T>( x / invlen, y / invlen, z / invlen ); };
+    Vector3D<T>  norm(void) const { T len = this->length(); IMU_TELEMETRY_HOOK(vectorNorm(len)); T invlen = 1 / len; return Vector3D<T>( x * invlen, y * invlen, z * invlen ); };
 
     /** Vector norm (in place).
      *
@@ -81,14 +88,14 @@ class Vector3D
      *
      * @return The normalized vector.
      */
-    Vector3D<T>  & normalize(void)  { T invlen = 1 / this->length(); x = x * invlen, y = y * invlen, z = z * invlen; return *this; };
+    Vector3D<T>  & normalize(void)  { T len = this->length(); IMU_TELEMETRY_HOOK(vectorNorm(len)); T invlen = 1 / len; x = x * invlen, y = y * invlen, z = z * invlen; return *this; };
 
     // Operators
     //Vector3D<T> & operator -  (const Vector3D<T> & rhs) const { return Vector3D<T>(-x, -y, -z); };  
     Vector3D<T> & operator += (const Vector3D<T> & rhs) { x += rhs.x, y += rhs.y, z += rhs.z; return *this; };
     Vector3D<T> & operator -= (const Vector3D<T> & rhs) { x -= rhs.x, y -= rhs.y, z -= rhs.z; return *this; };
-    //Vector3D<T> & operator *= (const Vector3D<T> & rhs);
-    //Vector3D<T> & operator /= (const Vector3D<T> & rhs);
+    Vector3D<T> & operator *= (const Vector3D<T> & rhs) { x *= rhs.x, y *= rhs.y, z *= rhs.z; return *this; };
+    Vector3D<T> & operator /= (const Vector3D<T> & rhs) { x /= rhs.x, y /= rhs.y, z /= rhs.z; return *this; };
 
     Vector3D<T> & operator += (const T & rhs) { x += rhs, y += rhs, z += rhs; return *this; };
     Vector3D<T> & operator -= (const T & rhs) { x -= rhs, y -= rhs, z -= rhs; return *this; };
@@ -0,0 +1,259 @@
+#ifndef __VECTOR_EXPR_H__
+#define __VECTOR_EXPR_H__
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+
+namespace IMU
+{
+
+/**
+ * Opt-in expression templates for element-wise Vector3D and Quaternion arithmetic.
+ *
+ * The plain operators build a full temporary per operator, so a + b * s - c
+ * costs three copies and three passes.  Wrapping an operand in lazy() makes
+ * the whole chain an expression that is evaluated in one pass, component by
+ * component, when it is assigned to a Vector3D<T> or Quaternion<T>:
+ *
+ *     Vector3D<T> r = lazy(a) + lazy(b) * s - c;
+ *
+ * Only operands reached through an expression are fused, b * s on its own
+ * still goes through the plain operator, hence the second lazy().  Supported
+ * are +, - and unary - between operands of the same kind, element-wise * and
+ * / between Vector3Ds, and +, -, * and / by a scalar of the element type (a
+ * Dual<T> for Vector3D<Dual<T> >, for instance).  Quaternion products are
+ * not element-wise and are not offered.
+ *
+ * An expression refers to its Vector3D and Quaternion operands, so it must be
+ * evaluated before they go away: never keep one in an auto variable.
+ */
+namespace expr
+{
+
+template <typename T, int N> struct Result;
+
+template <typename T>
+struct Result<T, 3>
+{
+    typedef Vector3D<T> type;
+    template <class E> static type make(const E & e) { return type(e[0], e[1], e[2]); };
+};
+
+template <typename T>
+struct Result<T, 4>
+{
+    typedef Quaternion<T> type;
+    template <class E> static type make(const E & e) { return type(e[0], e[1], e[2], e[3]); };
+};
+
+/** @class Expr
+*
+* Handle around an expression node.  Evaluates when converted to its result type.
+*/
+template <class Node>
+class Expr
+{
+    public:
+
+    typedef typename Node::value_type value_type;
+    enum { SIZE = Node::SIZE };
+    typedef typename Result<value_type, SIZE>::type result_type;
+
+    explicit Expr(const Node & n) : node(n) {};
+
+    value_type operator[](int i) const { return node[i]; };
+
+    /** Evaluate into a new Vector3D<T> or Quaternion<T>.
+     */
+    result_type eval(void) const { return Result<value_type, SIZE>::make(node); };
+    operator result_type(void) const { return eval(); };
+
+    const Node & get(void) const { return node; };
+
+    private:
+
+    Node node;
+}; // class Expr
+
+// Leaves
+
+template <typename T>
+struct VecRef
+{
+    typedef T value_type;
+    enum { SIZE = 3 };
+
+    explicit VecRef(const Vector3D<T> & v) : v(v) {};
+    T operator[](int i) const { return (i == 0) ? v.X() : (i == 1) ? v.Y() : v.Z(); };
+
+    const Vector3D<T> & v;
+};
+
+template <typename T>
+struct QuatRef
+{
+    typedef T value_type;
+    enum { SIZE = 4 };
+
+    explicit QuatRef(const Quaternion<T> & q) : q(q) {};
+    T operator[](int i) const { return (i == 0) ? q.W() : (i == 1) ? q.X() : (i == 2) ? q.Y() : q.Z(); };
+
+    const Quaternion<T> & q;
+};
+
+// Operations
+
+struct Add { template <typename T> static T apply(const T & a, const T & b) { return a + b; }; };
+struct Sub { template <typename T> static T apply(const T & a, const T & b) { return a - b; }; };
+struct Mul { template <typename T> static T apply(const T & a, const T & b) { return a * b; }; };
+struct Div { template <typename T> static T apply(const T & a, const T & b) { return a / b; }; };
+
+// Inner nodes, children held by value (they are references or small)
+
+template <class A, class B, class Op>
+struct Binary
+{
+    typedef typename A::value_type value_type;
+    enum { SIZE = A::SIZE };
+
+    static_assert((int)A::SIZE == (int)B::SIZE, "cannot mix Vector3D and Quaternion operands");
+
+    Binary(const A & a, const B & b) : a(a), b(b) {};
+    value_type operator[](int i) const { return Op::apply(a[i], b[i]); };
+
+    A a;
+    B b;
+};
+
+template <class A, class Op>
+struct ScalarRight
+{
+    typedef typename A::value_type value_type;
+    enum { SIZE = A::SIZE };
+
+    ScalarRight(const A & a, const value_type & s) : a(a), s(s) {};
+    value_type operator[](int i) const { return Op::apply(a[i], s); };
+
+    A          a;
+    value_type s;
+};
+
+template <class A, class Op>
+struct ScalarLeft
+{
+    typedef typename A::value_type value_type;
+    enum { SIZE = A::SIZE };
+
+    ScalarLeft(const value_type & s, const A & a) : a(a), s(s) {};
+    value_type operator[](int i) const { return Op::apply(s, a[i]); };
+
+    A          a;
+    value_type s;
+};
+
+template <class A>
+struct Negate
+{
+    typedef typename A::value_type value_type;
+    enum { SIZE = A::SIZE };
+
+    explicit Negate(const A & a) : a(a) {};
+    value_type operator[](int i) const { return -a[i]; };
+
+    A a;
+};
+
+/**
+ * Maps an operand type to its expression node.  Anything that is not a
+ * Vector3D, Quaternion or expression is not VALID, which keeps the generic
+ * operators below out of overload resolution.
+ */
+template <class X> struct Operand { enum { VALID = 0, LAZY = 0 }; };
+
+template <typename T>
+struct Operand<Vector3D<T> >
+{
+    typedef VecRef<T> node;
+    enum { VALID = 1, LAZY = 0 };
+    static node get(const Vector3D<T> & v) { return node(v); };
+};
+
+template <typename T>
+struct Operand<Quaternion<T> >
+{
+    typedef QuatRef<T> node;
+    enum { VALID = 1, LAZY = 0 };
+    static node get(const Quaternion<T> & q) { return node(q); };
+};
+
+template <class N>
+struct Operand<Expr<N> >
+{
+    typedef N node;
+    enum { VALID = 1, LAZY = 1 };
+    static const node & get(const Expr<N> & e) { return e.get(); };
+};
+
+/** Result of a binary operator, only defined when one side is an expression.
+ */
+template <class A, class B, class Op, bool = (Operand<A>::VALID && Operand<B>::VALID && (Operand<A>::LAZY || Operand<B>::LAZY))>
+struct BinaryExpr {};
+
+template <class A, class B, class Op>
+struct BinaryExpr<A, B, Op, true>
+{
+    typedef Expr<Binary<typename Operand<A>::node, typename Operand<B>::node, Op> > type;
+
+    static type make(const A & a, const B & b)
+    {
+        return type(Binary<typename Operand<A>::node, typename Operand<B>::node, Op>(Operand<A>::get(a), Operand<B>::get(b)));
+    }
+};
+
+template <class A, class B>
+    inline typename BinaryExpr<A, B, Add>::type operator + (const A & a, const B & b) { return BinaryExpr<A, B, Add>::make(a, b); };
+template <class A, class B>
+    inline typename BinaryExpr<A, B, Sub>::type operator - (const A & a, const B & b) { return BinaryExpr<A, B, Sub>::make(a, b); };
+
+template <class A, class B>
+    inline typename BinaryExpr<A, B, Mul>::type operator * (const A & a, const B & b)
+{
+    static_assert((int)Operand<A>::node::SIZE == 3, "element-wise product is for Vector3D only");
+    return BinaryExpr<A, B, Mul>::make(a, b);
+};
+
+template <class A, class B>
+    inline typename BinaryExpr<A, B, Div>::type operator / (const A & a, const B & b)
+{
+    static_assert((int)Operand<A>::node::SIZE == 3, "element-wise quotient is for Vector3D only");
+    return BinaryExpr<A, B, Div>::make(a, b);
+};
+
+template <class N>
+    inline Expr<ScalarRight<N, Add> > operator + (const Expr<N> & a, const typename N::value_type & s) { return Expr<ScalarRight<N, Add> >(ScalarRight<N, Add>(a.get(), s)); };
+template <class N>
+    inline Expr<ScalarRight<N, Sub> > operator - (const Expr<N> & a, const typename N::value_type & s) { return Expr<ScalarRight<N, Sub> >(ScalarRight<N, Sub>(a.get(), s)); };
+template <class N>
+    inline Expr<ScalarRight<N, Mul> > operator * (const Expr<N> & a, const typename N::value_type & s) { return Expr<ScalarRight<N, Mul> >(ScalarRight<N, Mul>(a.get(), s)); };
+template <class N>
+    inline Expr<ScalarRight<N, Div> > operator / (const Expr<N> & a, const typename N::value_type & s) { return Expr<ScalarRight<N, Div> >(ScalarRight<N, Div>(a.get(), s)); };
+template <class N>
+    inline Expr<ScalarLeft<N, Mul> >  operator * (const typename N::value_type & s, const Expr<N> & a) { return Expr<ScalarLeft<N, Mul> >(ScalarLeft<N, Mul>(s, a.get())); };
+template <class N>
+    inline Expr<Negate<N> >           operator - (const Expr<N> & a) { return Expr<Negate<N> >(Negate<N>(a.get())); };
+
+}; // namespace expr
+
+/** Start a fused expression from a Vector3D.
+ */
+template <typename T>
+    inline expr::Expr<expr::VecRef<T> >  lazy(const Vector3D<T> & v)   { return expr::Expr<expr::VecRef<T> >(expr::VecRef<T>(v)); };
+
+/** Start a fused expression from a Quaternion.
+ */
+template <typename T>
+    inline expr::Expr<expr::QuatRef<T> > lazy(const Quaternion<T> & q) { return expr::Expr<expr::QuatRef<T> >(expr::QuatRef<T>(q)); };
+
+}; // namespace IMU
+
+#endif //__VECTOR_EXPR_H__
@@ -0,0 +1,422 @@
+#ifndef __VIRTUAL_IMU_H__
+#define __VIRTUAL_IMU_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <Vector3D.h>
+#include <Quaternion.h>
+#include <QuaternionBatch.h>
+#include <ImuSample.h>
+
+namespace IMU
+{
+
+/** @class VirtualImu
+*
+* Fuses up to N rigidly mounted IMUs into one virtual IMU at the body origin.
+*
+* Each sensor has a mounting rotation (sensor to body, as for
+* Quaternion<T>::rot()), a lever arm (its position in the body frame) and
+* gyro and accel noise sigmas.  Per epoch the readings are rotated into the
+* body frame and combined with inverse variance weights.
+*
+* Accel readings differ by the lever arm terms w x (w x r) + dw/dt x r.  The
+* centripetal part is removed with the fused gyro.  The angular acceleration
+* is not differentiated from the gyro, which would multiply gyro noise by
+* the sample rate, but fitted together with the specific force by weighted
+* least squares across the accel array.  That needs three or more sensors
+* not on one line, otherwise it is taken as zero.  It reaches the fused
+* accel only through the weighted centroid of the lever arms, so an array
+* centred on the origin does not depend on it.
+*
+* Outlier rejection (off by default) drops, up to maxOutliers times per
+* epoch and per quantity, the sensor with the largest normalized residual
+* from the fit to all sensors left, if its square exceeds the gate.  It
+* needs at least 3 sensors left to decide which one is wrong.
+*
+* The mounting matrices are expanded once by addSensor().  All per epoch
+* work runs over N lanes of structure-of-arrays, whatever the number of
+* sensors, as straight loops the compiler vectorizes; unused or masked
+* lanes have weight 0.  N must be a power of two, at most 32.
+*/
+template <typename T, size_t N = 16>
+class VirtualImu
+{
+    static_assert(N != 0 && N <= 32 && (N & (N - 1)) == 0, "VirtualImu lanes must be a power of two up to 32");
+
+    public:
+
+    /** Default constructor, no sensors, outlier rejection off.
+     */
+    VirtualImu(void) : n(0), gate(0), maxOutliers(0), gRej(0), aRej(0)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            for (int k = 0; k < 9; k++) m[k][i] = 0;
+            rx[i] = ry[i] = rz[i] = 0;
+            wg[i] = wa[i] = 0;
+            gyr[0][i] = gyr[1][i] = gyr[2][i] = acc[0][i] = acc[1][i] = acc[2][i] = live[i] = 0;
+            w[i] = t[i] = 0;
+        }
+    }
+
+    /**
+     * Add a sensor.
+     *
+     * @param mount      Rotation from the sensor frame to the body frame.
+     * @param lever      Sensor position in the body frame.
+     * @param gyroSigma  Gyro noise, per axis, > 0.
+     * @param accelSigma Accel noise, per axis, > 0.
+     *
+     * @return Sensor index, -1 if all N slots are taken.
+     */
+    int addSensor(const Quaternion<T> & mount, const Vector3D<T> & lever, const T & gyroSigma, const T & accelSigma)
+    {
+        T r[9];
+
+        if (n == N) return -1;
+
+        detail::rotMatrix(mount, r);
+        for (int k = 0; k < 9; k++) m[k][n] = r[k];
+        rx[n] = lever.X(), ry[n] = lever.Y(), rz[n] = lever.Z();
+        wg[n] = 1 / (gyroSigma * gyroSigma);
+        wa[n] = 1 / (accelSigma * accelSigma);
+        return int(n++);
+    }
+
+    /** Number of sensors added. */
+    size_t sensors(void) const { return n; };
+
+    /**
+     * Outlier rejection.
+     *
+     * @param chi2        Gate on the squared normalized residual of a sensor
+     *                    (3 degrees of freedom, 16.3 rejects about 0.1% of
+     *                    healthy readings).
+     * @param maxOutliers Sensors that may be dropped per epoch, 0 turns
+     *                    rejection off.
+     */
+    void setOutlierRejection(const T & chi2, size_t maxOutliers = 1) { gate = chi2; this->maxOutliers = maxOutliers; };
+
+    /**
+     * Fuse one epoch.
+     *
+     * @param gyro  Gyro reading of each sensor, sensor frame, rad/s.
+     * @param accel Accel reading of each sensor, sensor frame.
+     * @param g     Fused gyro, body frame.
+     * @param a     Fused accel at the body origin, body frame.
+     * @param valid Bit i clear excludes sensor i (its readings are not read).
+     *
+     * @return false if no sensor is left for the gyro or the accel.
+     */
+    bool fuse(const Vector3D<T> * gyro, const Vector3D<T> * accel, Vector3D<T> & g, Vector3D<T> & a, uint32_t valid = ~uint32_t(0))
+    {
+        valid &= mask();
+        for (size_t i = 0; i < n; i++)
+        {
+            const bool on = (valid >> i) & 1;
+
+            load(i, on, on ? gyro[i] : Vector3D<T>(), on ? accel[i] : Vector3D<T>());
+        }
+        return fuse(g, a, valid);
+    }
+
+    /**
+     * Fuse one epoch of samples, one per sensor, as above.  out.stamp is the
+     * stamp of the first valid sample, out.mag is zero.
+     */
+    bool fuse(const ImuSample<T> * s, ImuSample<T> & out, uint32_t valid = ~uint32_t(0))
+    {
+        valid &= mask();
+        out = ImuSample<T>();
+        for (size_t i = 0; i < n; i++)
+        {
+            const bool on = (valid >> i) & 1;
+
+            load(i, on, on ? s[i].gyro : Vector3D<T>(), on ? s[i].accel : Vector3D<T>());
+            if (on && !out.stamp) out.stamp = s[i].stamp;
+        }
+        return fuse(out.gyro, out.accel, valid);
+    }
+
+    /** Angular acceleration fitted in the last epoch, body frame; zero if the array cannot observe it. */
+    const Vector3D<T> & angularAccel(void) const { return dw; };
+
+    /** Sensors whose gyro / accel was rejected as an outlier in the last epoch, bit i for sensor i. */
+    uint32_t gyroRejected(void)  const { return gRej; };
+    uint32_t accelRejected(void) const { return aRej; };
+
+    private:
+
+    uint32_t mask(void) const { return (n >= 32) ? ~uint32_t(0) : (uint32_t(1) << n) - 1; };
+
+    void load(size_t i, bool on, const Vector3D<T> & gyro, const Vector3D<T> & accel)
+    {
+        gyr[0][i] = gyro.X(),  gyr[1][i] = gyro.Y(),  gyr[2][i] = gyro.Z();
+        acc[0][i] = accel.X(), acc[1][i] = accel.Y(), acc[2][i] = accel.Z();
+        live[i] = on ? T(1) : T(0);
+    }
+
+    /** Rotate v into the body frame, all lanes. */
+    void rotate(T (* v)[N])
+    {
+        T * const x = v[0], * const y = v[1], * const z = v[2];
+
+        for (size_t i = 0; i < N; i++)
+        {
+            const T vx = x[i], vy = y[i], vz = z[i];
+
+            x[i] = m[0][i] * vx + m[1][i] * vy + m[2][i] * vz;
+            y[i] = m[3][i] * vx + m[4][i] * vy + m[5][i] * vz;
+            z[i] = m[6][i] * vx + m[7][i] * vy + m[8][i] * vz;
+        }
+    }
+
+    /**
+     * mo[j] = sum of the N lanes of a[j], j < k.  Four interleaved running
+     * sums, vectorized across them, then pairwise: the order does not
+     * depend on the values or the number of sensors.
+     */
+    static void reduce(const T (* a)[N], int k, T * mo)
+    {
+        const size_t L = (N < 4) ? N : 4;
+        T            q[MOMENTS][4];
+
+        for (int j = 0; j < k; j++)
+        {
+            for (size_t l = 0; l < L; l++)
+            {
+                T sum = a[j][l];
+
+                for (size_t i = L; i < N; i += L) sum += a[j][i + l];
+                q[j][l] = sum;
+            }
+            for (size_t l = L; l < 4; l++) q[j][l] = 0;
+        }
+        for (int j = 0; j < k; j++) mo[j] = (q[j][0] + q[j][2]) + (q[j][1] + q[j][3]);
+    }
+
+    template <bool LEVER> bool fit(Vector3D<T> & out, uint32_t valid, uint32_t & rejected);
+    template <bool LEVER> void moments(T * mo);
+    bool fuse(Vector3D<T> & g, Vector3D<T> & a, uint32_t valid);
+
+    // Weighted sums of fit(), one lane per sensor in p[k].
+    enum { MO_W = 0, MO_B = 1, MO_R = 4, MO_RR = 7, MO_RXB = 13, MOMENTS = 16 };
+
+    // Configuration, one lane per sensor, zero in unused lanes.
+    alignas(64) T m[9][N];          // mounting matrices, row-major element k of sensor i in m[k][i]
+    alignas(64) T rx[N], ry[N], rz[N];
+    alignas(64) T wg[N], wa[N];     // inverse variances
+
+    // Per epoch.
+    alignas(64) T gyr[3][N];        // readings, sensor frame, body frame after rotate()
+    alignas(64) T acc[3][N];
+    alignas(64) T live[N];          // 1 for sensors read this epoch
+    alignas(64) T w[N];             // weights, 0 once rejected
+    alignas(64) T p[MOMENTS][N];    // per sensor terms of the moments
+    alignas(64) T t[N];
+
+    size_t      n;
+    T           gate;
+    size_t      maxOutliers;
+    Vector3D<T> dw;
+    uint32_t    gRej, aRej;
+}; // class VirtualImu
+
+template <typename T, size_t N>
+bool
+VirtualImu<T, N>::fuse(Vector3D<T> & g, Vector3D<T> & a, uint32_t valid)
+{
+    dw = Vector3D<T>();
+    aRej = 0;
+
+    rotate(gyr);
+    if (!fit<false>(g, valid, gRej)) return false;
+
+    const T wx = g.X(), wy = g.Y(), wz = g.Z();
+
+    // Remove the centripetal term w x (w x r).
+    rotate(acc);
+    for (size_t i = 0; i < N; i++)
+    {
+        const T px = wy * rz[i] - wz * ry[i];
+        const T py = wz * rx[i] - wx * rz[i];
+        const T pz = wx * ry[i] - wy * rx[i];
+
+        acc[0][i] -= wy * pz - wz * py;
+        acc[1][i] -= wz * px - wx * pz;
+        acc[2][i] -= wx * py - wy * px;
+    }
+    return fit<true>(a, valid, aRej);
+}
+
+/**
+ * Fill p with the per sensor terms of the weighted sums and mo with the
+ * sums: W, sum w b and, with LEVER, sum w r, the upper triangle of
+ * sum w r r^T (xx, yy, zz, xy, xz, yz) and sum w r x b.
+ */
+template <typename T, size_t N>
+template <bool LEVER>
+void
+VirtualImu<T, N>::moments(T * mo)
+{
+    const T * const x = LEVER ? acc[0] : gyr[0];
+    const T * const y = LEVER ? acc[1] : gyr[1];
+    const T * const z = LEVER ? acc[2] : gyr[2];
+    const int       k = LEVER ? MOMENTS : MO_R;
+
+    for (size_t i = 0; i < N; i++)
+    {
+        const T wi = w[i];
+
+        p[MO_W][i]     = wi;
+        p[MO_B][i]     = wi * x[i];
+        p[MO_B + 1][i] = wi * y[i];
+        p[MO_B + 2][i] = wi * z[i];
+        if (LEVER)
+        {
+            const T wx = wi * rx[i], wy = wi * ry[i], wz = wi * rz[i];
+
+            p[MO_R][i]      = wx;
+            p[MO_R + 1][i]  = wy;
+            p[MO_R + 2][i]  = wz;
+            p[MO_RR][i]     = wx * rx[i];
+            p[MO_RR + 1][i] = wy * ry[i];
+            p[MO_RR + 2][i] = wz * rz[i];
+            p[MO_RR + 3][i] = wx * ry[i];
+            p[MO_RR + 4][i] = wx * rz[i];
+            p[MO_RR + 5][i] = wy * rz[i];
+            p[MO_RXB][i]     = wy * z[i] - wz * y[i];
+            p[MO_RXB + 1][i] = wz * x[i] - wx * z[i];
+            p[MO_RXB + 2][i] = wx * y[i] - wy * x[i];
+        }
+    }
+
+    reduce(p, k, mo);
+}
+
+/**
+ * Weighted least squares fit to the lanes of x, y, z, with rejection.
+ *
+ * Without LEVER the model is the weighted mean.  With LEVER it is
+ * a0 + dw x r, solved with the lever arms r' = r - r0 from their weighted
+ * centroid r0: the mean is a0 + dw x r0 and
+ * (sum w (|r'|^2 I - r' r'^T)) dw = sum w r' x b, both from the moments.
+ * A rejected sensor's terms are subtracted from the moments, so refits do
+ * not go over the lanes again.
+ */
+template <typename T, size_t N>
+template <bool LEVER>
+bool
+VirtualImu<T, N>::fit(Vector3D<T> & out, uint32_t valid, uint32_t & rejected)
+{
+    const T * const x  = LEVER ? acc[0] : gyr[0];
+    const T * const y  = LEVER ? acc[1] : gyr[1];
+    const T * const z  = LEVER ? acc[2] : gyr[2];
+    const T * const w0 = LEVER ? wa : wg;
+    const int       k  = LEVER ? MOMENTS : MO_R;
+    T               mo[MOMENTS];
+
+    for (size_t i = 0; i < N; i++) w[i] = w0[i] * live[i];
+    moments<LEVER>(mo);
+
+    rejected = 0;
+    for (size_t pass = 0; ; pass++)
+    {
+        const T W = mo[MO_W];
+
+        if (!(W > T(0))) return false;
+
+        const T           inv    = 1 / W;
+        const Vector3D<T> mean(mo[MO_B] * inv, mo[MO_B + 1] * inv, mo[MO_B + 2] * inv);
+        const int         active = __builtin_popcount(valid & ~rejected);
+        Vector3D<T>       a0 = mean;
+
+        if (LEVER && active >= 3)
+        {
+            const Vector3D<T> r0(mo[MO_R] * inv, mo[MO_R + 1] * inv, mo[MO_R + 2] * inv);
+            const T           xx = mo[MO_RR]     - W * r0.X() * r0.X();
+            const T           yy = mo[MO_RR + 1] - W * r0.Y() * r0.Y();
+            const T           zz = mo[MO_RR + 2] - W * r0.Z() * r0.Z();
+            const T           xy = mo[MO_RR + 3] - W * r0.X() * r0.Y();
+            const T           xz = mo[MO_RR + 4] - W * r0.X() * r0.Z();
+            const T           yz = mo[MO_RR + 5] - W * r0.Y() * r0.Z();
+            const Vector3D<T> h  = Vector3D<T>(mo[MO_RXB], mo[MO_RXB + 1], mo[MO_RXB + 2]) - r0.cross(mean) * W;
+
+            // A small ridge keeps a nearly collinear array from amplifying
+            // noise.  The matrix is symmetric: solved by its adjugate.
+            const T ridge = (xx + yy + zz) * T(1e-4);
+            const T a = yy + zz + ridge, b = xx + zz + ridge, c = xx + yy + ridge;
+            const T c00 = b * c - yz * yz, c01 = xy * c + xz * yz, c02 = xy * yz + b * xz;
+            const T c11 = a * c - xz * xz, c12 = a * yz + xy * xz, c22 = a * b - xy * xy;
+            const T det = a * c00 - xy * c01 - xz * c02;
+
+            if (ridge > T(0) && det > T(0))
+            {
+                const T id = 1 / det;
+
+                dw.set((c00 * h.X() + c01 * h.Y() + c02 * h.Z()) * id,
+                       (c01 * h.X() + c11 * h.Y() + c12 * h.Z()) * id,
+                       (c02 * h.X() + c12 * h.Y() + c22 * h.Z()) * id);
+            }
+            else
+            {
+                dw = Vector3D<T>();
+            }
+            a0 = mean - dw.cross(r0);
+        }
+        if (pass == maxOutliers || active < 3)
+        {
+            out = a0;
+            return true;
+        }
+
+        // Residual from the fit, in units of its variance 1 / w - 1 / W
+        // (that of the mean, slightly low for the lever arm model).
+        const T dx = dw.X(), dy = dw.Y(), dz = dw.Z();
+        const T mx = a0.X(), my = a0.Y(), mz = a0.Z();
+        size_t  worst = 0;
+
+        for (size_t i = 0; i < N; i++)
+        {
+            T ex = x[i] - mx, ey = y[i] - my, ez = z[i] - mz;
+
+            if (LEVER)
+            {
+                ex -= dy * rz[i] - dz * ry[i];
+                ey -= dz * rx[i] - dx * rz[i];
+                ez -= dx * ry[i] - dy * rx[i];
+            }
+            t[i] = (ex * ex + ey * ey + ez * ez) * w[i] * W / (W - w[i] + (T(1) - live[i]));
+        }
+
+        // Maximum first, four lanes at a time; the usual epoch stops there.
+        const size_t L = (N < 4) ? N : 4;
+        T            q[4];
+
+        for (size_t l = 0; l < L; l++)
+        {
+            q[l] = t[l];
+            for (size_t i = L; i < N; i += L) q[l] = (t[i + l] > q[l]) ? t[i + l] : q[l];
+        }
+
+        T top = q[0];
+
+        for (size_t l = 1; l < L; l++) top = (q[l] > top) ? q[l] : top;
+        if (!(top > gate))
+        {
+            out = a0;
+            return true;
+        }
+        while (t[worst] != top) worst++;
+
+        for (int j = 0; j < k; j++) mo[j] -= p[j][worst];
+        w[worst] = 0;
+        rejected |= uint32_t(1) << worst;
+    }
+}
+
+}; // namespace IMU
+
+#endif //__VIRTUAL_IMU_H__